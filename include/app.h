@@ -27,6 +27,9 @@
 # define MAX_RECENT_ROMS            5
 # define MAX_QUICKSAVES             5
 # define POWER_SAVE_FRAME_DELAY     30
+# define GAME_TEXTURE_PBO_COUNT     3
+# define AUDIO_BUFFER_SIZE_MIN      256
+# define AUDIO_BUFFER_SIZE_MAX      4096
 
 struct ImGuiIO;
 
@@ -111,6 +114,10 @@ struct app {
         // RTC
         bool rtc_autodetect;
         bool rtc_force_enabled;
+
+        // Scheduling of the emulation thread
+        bool realtime_priority;
+        int32_t cpu_affinity;       // -1 means no affinity
     } emulation;
 
     struct {
@@ -119,6 +126,29 @@ struct app {
         SDL_AudioDeviceID audio_device;
         GLuint game_texture;
 
+        /*
+        ** SDL user event pushed by the emulation thread when a new frame is available.
+        ** `frame_event_pending` is used to avoid flooding the event queue when the GUI is lagging behind.
+        */
+        uint32_t frame_event;
+        atomic_bool frame_event_pending;
+
+        /* Sequence number of the frame currently held by `game_texture` */
+        uint32_t game_texture_seq;
+
+        /*
+        ** Ring of persistently mapped pixel buffer objects used to stream the frames to `game_texture`.
+        **
+        ** Only used if the driver supports `ARB_buffer_storage` and `ARB_sync`.
+        */
+        struct {
+            bool enabled;
+            GLuint buffer;
+            uint8_t *mapped;
+            GLsync fences[GAME_TEXTURE_PBO_COUNT];
+            size_t idx;
+        } game_pbo;
+
         /* Game controller */
         struct {
             SDL_GameController *ptr;
@@ -157,6 +187,11 @@ struct app {
         enum aspect_ratio aspect_ratio;
         bool vsync;
         bool color_correction;
+        bool threaded_rendering;
+        int32_t frame_skip;
+
+        /* Render the GUI right before the next vsync instead of as soon as a frame is available */
+        bool present_deadline;
 
         struct {
             enum texture_filter_kind kind;
@@ -168,6 +203,19 @@ struct app {
     struct {
         bool mute;
         float level;
+
+        /* Size of the audio device's buffer, in frames */
+        uint32_t buffer_size;
+
+        /* Pace the emulation on the audio device instead of the frame limiter */
+        bool audio_master;
+
+        /* Preserve the pitch of the audio when fast-forwarding */
+        bool time_stretch;
+
+        /* Audio recording */
+        bool record_sources;
+        enum apu_record_format record_format;
     } audio;
 
     struct {
@@ -184,6 +232,12 @@ struct app {
         /* How many frames before going back to power save mode? */
         uint32_t power_save_fcounter;
 
+        /* Timings used to schedule the rendering of the GUI, in performance counter units */
+        struct {
+            uint64_t last_swap;
+            uint64_t render_time;
+        } present;
+
         /* Temporary value used to measure the FPS. */
         uint32_t ticks_last_frame;
 
@@ -267,6 +321,8 @@ void app_game_run(struct app *app);
 void app_game_pause(struct app *app);
 void app_game_write_backup(struct app *app);
 void app_game_screenshot(struct app *app);
+void app_game_record_audio(struct app *app);
+void app_game_stop_audio_recording(struct app *app);
 void app_game_quicksave(struct app *, size_t);
 void app_game_quickload(struct app *, size_t);
 
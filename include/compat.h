@@ -165,6 +165,35 @@ hs_tick_count(void)
     return (time);
 }
 
+static inline
+uint64_t
+hs_tick_count_ns(void)
+{
+    LARGE_INTEGER counter;
+    LARGE_INTEGER freq;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&freq);
+    return ((uint64_t)counter.QuadPart / freq.QuadPart * 1000000000ull + (uint64_t)counter.QuadPart % freq.QuadPart * 1000000000ull / freq.QuadPart);
+}
+
+/*
+** Sleep until `hs_tick_count_ns()` reaches `deadline`.
+** Windows has no absolute sleep so this may oversleep by the timer's resolution.
+*/
+static inline
+void
+hs_sleep_until_ns(
+    uint64_t deadline
+) {
+    uint64_t now;
+
+    now = hs_tick_count_ns();
+    if (deadline > now) {
+        hs_usleep((deadline - now) / 1000);
+    }
+}
+
 static inline
 void
 hs_open_url(
@@ -176,6 +205,7 @@ hs_open_url(
 # else
 #  include <sys/stat.h>
 #  include <unistd.h>
+#  include <errno.h>
 #  include <time.h>
 
 #  define hs_isatty(x)          isatty(x)
@@ -205,6 +235,47 @@ hs_tick_count(void)
     return (ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
 }
 
+static inline
+uint64_t
+hs_tick_count_ns(void)
+{
+    struct timespec ts;
+
+    hs_assert(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+    return (ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
+
+/*
+** Sleep until `hs_tick_count_ns()` reaches `deadline`.
+**
+** The deadline is absolute so, unlike relative sleeps, the time spent between computing it and
+** actually going to sleep doesn't accumulate.
+*/
+static inline
+void
+hs_sleep_until_ns(
+    uint64_t deadline
+) {
+#if __APPLE__
+    struct timespec ts;
+    uint64_t now;
+
+    /* No `clock_nanosleep()` on MacOS */
+    now = hs_tick_count_ns();
+    if (deadline > now) {
+        ts.tv_sec = (deadline - now) / 1000000000ull;
+        ts.tv_nsec = (deadline - now) % 1000000000ull;
+        nanosleep(&ts, NULL);
+    }
+#else
+    struct timespec ts;
+
+    ts.tv_sec = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#endif
+}
+
 static inline
 char *
 hs_fmtime(
@@ -11,17 +11,91 @@
 # define GBA_APU_H
 
 # include <pthread.h>
+# include <stdatomic.h>
+# include <stdio.h>
 
 # define FIFO_CAPACITY      32
 
 // TODO: This should be dynamically set to a least 3x the value contained in `have.samples` (see `gui/sdl/audio.c`)
-# define APU_RBUFFER_CAPACITY (2048 * 3)
+// Must be a power of two.
+# define APU_RBUFFER_CAPACITY (2048 * 4)
+
+/* Maximum time the producer waits for room in the ring buffer, in milliseconds */
+# define APU_RBUFFER_MAX_WAIT 100
+
+# define APU_CHANGE_LOG_CAPACITY    512
+# define APU_MIX_BATCH_SIZE         256
+
+# define APU_BLIP_PHASES            32
+# define APU_BLIP_TAPS              16
+# define APU_BLIP_SHIFT             12
+# define APU_BLIP_SIZE              (APU_MIX_BATCH_SIZE + APU_BLIP_TAPS)
+
+/* Size of each of the recorder's buffers, in samples. Must be a power of two. */
+# define APU_RECORDER_CAPACITY      (1 << 18)
+
+/* How often the recorder's writer thread wakes up to write the recorded samples, in milliseconds */
+# define APU_RECORDER_PERIOD        20
+
+/* Number of fractional bits of the resampling periods */
+# define APU_RESAMPLE_SHIFT         16
+
+/* Maximum adjustment of the resampling rate done by the dynamic rate control, in 1/1000th */
+# define APU_RATE_CONTROL_MAX       5
+
+/*
+** Parameters of the time-stretcher, in frames (40ms, 15ms and 8ms at 48kHz).
+**
+** Each sequence is overlapped with the previous one by `APU_STRETCH_OVERLAP` frames, and its
+** start is searched within `APU_STRETCH_SEEK` frames of its nominal position.
+*/
+# define APU_STRETCH_SEQUENCE       1920
+# define APU_STRETCH_SEEK           720
+# define APU_STRETCH_OVERLAP        384
+# define APU_STRETCH_INPUT_SIZE     (APU_STRETCH_SEQUENCE + APU_STRETCH_SEEK + APU_MIX_BATCH_SIZE)
+
+/* Number of fractional bits of the time-stretcher's ratio */
+# define APU_STRETCH_SHIFT          16
+
+/* How long the emulation speed is measured before updating the time-stretcher's ratio, in milliseconds */
+# define APU_STRETCH_WINDOW         100
+
+/* Maximum adjustment of the time-stretcher's ratio to keep the frontend's ring buffer filled, in 1/1000th */
+# define APU_STRETCH_CONTROL_MAX    50
+
+enum apu_record_format {
+    APU_RECORD_WAV = 0,
+    APU_RECORD_RAW,                     // Signed 16 bits samples, interleaved, in the host's byte order
+};
+
+/*
+** The sources the recorder can record separately, each one in its own channel.
+*/
+enum apu_record_source {
+    APU_SOURCE_TONE_1 = 0,
+    APU_SOURCE_TONE_2,
+    APU_SOURCE_WAVE,
+    APU_SOURCE_NOISE,
+    APU_SOURCE_FIFO_A,
+    APU_SOURCE_FIFO_B,
+    APU_SOURCE_MAX,
+};
 
 enum fifo_idx {
     FIFO_A = 0,
     FIFO_B = 1,
 };
 
+/*
+** The PSG channels whose waveform is synthesized by the mixer (see `gba/apu/psg.c`).
+*/
+enum psg_idx {
+    PSG_TONE_1 = 0,
+    PSG_TONE_2 = 1,
+    PSG_NOISE = 2,
+    PSG_MAX,
+};
+
 struct fifo {
     int8_t data[FIFO_CAPACITY];
     size_t read_idx;
@@ -30,44 +104,324 @@ struct fifo {
 };
 
 struct wave {
-    uint32_t step;
+    bool enabled;
+    uint64_t start;                     // When the channel was started, in cycles
+    uint32_t period;                    // Duration of a step, in cycles
+    uint64_t steps;                     // Number of steps done at the last call to `apu_wave_sync()`
     uint32_t length;
-    event_handler_t step_handler;
-    event_handler_t counter_handler;
+    uint8_t trigger;                    // Incremented each time the channel is restarted
 };
 
+struct psg_channel {
+    bool enabled;
+    uint32_t length;
+    uint8_t trigger;                    // Incremented each time the channel is restarted
+
+    struct {
+        uint32_t volume;
+        uint32_t period;
+        uint32_t timer;
+        bool increase;
+    } envelope;
+};
+
+struct sweep {
+    bool enabled;
+    uint32_t timer;
+    uint32_t frequency;                 // The shadow frequency register
+};
+
+/*
+** A lock-free single-producer/single-consumer ring buffer of stereo frames.
+**
+** The emulation thread is the only producer and the audio callback the only consumer.
+** Both indexes are free-running (they are only wrapped when accessing `data`) and each one is only
+** written by its owner, on its own cache line to avoid false sharing.
+*/
 struct apu_rbuffer {
+    atomic_size_t write_idx;
+    atomic_uint overruns;               // Frames dropped because the buffer was full
+    uint8_t _pad0[CACHE_LINE_SIZE];
+
+    atomic_size_t read_idx;
+    atomic_uint underruns;              // Frames requested while the buffer was empty
+    uint32_t last_frame;
+    uint8_t _pad1[CACHE_LINE_SIZE];
+
+    /* Used by the producer to wait for room in the buffer, see `apu_rbuffer_wait_space()`. */
+    atomic_bool waiting;
+    pthread_mutex_t lock;
+    pthread_cond_t space;
+    uint8_t _pad2[CACHE_LINE_SIZE];
+
     uint32_t data[APU_RBUFFER_CAPACITY];
-    size_t read_idx;
-    size_t write_idx;
-    size_t size;
+};
+
+/*
+** The parameters of a PSG channel's waveform generator.
+*/
+struct apu_psg_input {
+    uint32_t period;                    // Duration of a step of the generator, in cycles. 0 if it is stopped.
+    uint8_t volume;                     // The envelope's volume (0 to 15), or 0 if the channel is disabled
+    uint8_t mode;                       // The duty cycle (tone) or whether the LFSR is 7 bits wide (noise)
+    uint8_t trigger;
+    uint8_t _pad;
+};
+
+/*
+** The parameters of the wave channel.
+*/
+struct apu_wave_input {
+    uint32_t period;                    // Duration of a step, in cycles. 0 if the channel is stopped.
+    uint8_t volume;
+    uint8_t bank_mode;
+    uint8_t bank_select;
+    uint8_t trigger;
+    uint8_t waveram[2][16];
+};
+
+/*
+** A file written by the recorder and the single-producer/single-consumer ring buffer of interleaved
+** samples feeding it.
+**
+** The emulation thread is the producer and the recorder's writer thread the consumer.
+*/
+struct apu_record_stream {
+    FILE *file;
+    uint32_t channels;
+    uint64_t data_size;                 // Number of bytes written to `file` (writer's side)
+
+    atomic_size_t write_idx;
+    uint8_t _pad0[CACHE_LINE_SIZE];
+
+    atomic_size_t read_idx;
+    uint8_t _pad1[CACHE_LINE_SIZE];
+
+    int16_t data[APU_RECORDER_CAPACITY];
+};
+
+/*
+** The audio recorder (see `gba/apu/recorder.c`).
+*/
+struct apu_recorder {
+    bool active;                        // Emulator's side
+    bool record_sources;                // Emulator's side
+    enum apu_record_format format;
+    uint32_t sample_rate;
+
+    /* The level of each source, held until it changes (emulator's side) */
+    int16_t levels[APU_SOURCE_MAX];
+
+    /* Samples dropped because the writer thread couldn't keep up */
+    atomic_uint dropped;
+
+    /* Set while a recording is in progress, for the frontend */
+    atomic_bool recording;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool stop;                          // Protected by `lock`
+
+    struct apu_record_stream mix;
+    struct apu_record_stream sources;
+};
+
+/*
+** The time-stretcher (see `gba/apu/stretch.c`).
+*/
+struct apu_stretch {
+    bool enabled;                       // Set by the frontend
+    bool active;                        // Whether the output is currently being stretched
+
+    /* How many input frames are consumed for each output frame (fixed-point, see `APU_STRETCH_SHIFT`) */
+    uint64_t ratio;
+
+    /* Measurement of the emulation speed */
+    uint64_t window_start;              // In nanoseconds
+    uint64_t window_cycles;
+
+    /* Frames waiting to be stretched, and their mono downmix used to find the best overlap */
+    uint32_t input[APU_STRETCH_INPUT_SIZE];
+    int16_t input_mono[APU_STRETCH_INPUT_SIZE];
+    size_t input_len;
+
+    /* Input frames to drop before filling `input` again, and the fractional part of the next skip */
+    uint64_t skip;
+    uint64_t skip_frac;
+
+    /* The end of the previous sequence, cross-faded with the start of the next one */
+    uint32_t overlap[APU_STRETCH_OVERLAP];
+    int16_t overlap_mono[APU_STRETCH_OVERLAP];
+    bool has_overlap;
+};
+
+/*
+** Everything the mixer's output depends on.
+*/
+struct apu_mixer_input {
+    int16_t fifo[2];
+    uint16_t soundcnt_l;
+    uint16_t soundcnt_h;
+    uint16_t bias;
+    uint16_t _pad;
+    struct apu_psg_input psg[PSG_MAX];
+    struct apu_wave_input wave;
+};
+
+/*
+** The waveform generator of a PSG channel.
+**
+** Generators aren't driven by scheduler events: they are only advanced by the mixer, which computes
+** their position from the time of their next step and their period.
+*/
+struct apu_psg_generator {
+    uint64_t next;                      // When the next step is due, in cycles
+    uint32_t state;                     // The position in the duty cycle (tone) or the LFSR (noise)
+    uint8_t trigger;                    // The input's `trigger` when the generator was last restarted
+    bool high;                          // The current output level
+};
+
+/*
+** The mixer's generator of the wave channel.
+*/
+struct apu_wave_generator {
+    uint64_t next;                      // When the next step is due, in cycles
+    uint32_t step;                      // Position in the current bank
+    uint32_t bank;                      // The bank being played
+    uint8_t trigger;                    // The input's `trigger` when the generator was last restarted
+    int16_t sample;                     // The current output
+};
+
+/*
+** An entry of the mixer's change log: the mixer's inputs as they were set at `timestamp`.
+*/
+struct apu_change {
+    uint64_t timestamp;
+    struct apu_mixer_input input;
+};
+
+/*
+** State of the band-limited synthesizer (see `gba/apu/blip.c`).
+*/
+struct apu_blip {
+    int32_t deltas[2][APU_BLIP_SIZE];   // Band-limited amplitude changes, starting at sample `next`
+    int32_t integrator[2];              // Running sum of the deltas already output
+    int32_t amplitude[2];               // The current amplitude, once all the pending deltas are summed
+    uint64_t next_time;                 // When the next sample is due, in cycles (fixed-point, see `APU_RESAMPLE_SHIFT`)
 };
 
 struct apu {
-    uint64_t resample_frequency; // In cycles
+    /*
+    ** The duration of an output sample, in cycles (fixed-point, see `APU_RESAMPLE_SHIFT`).
+    **
+    ** `resample_step` is `resample_period` adjusted by the dynamic rate control, which tries to keep
+    ** `target_fill` frames in the frontend's ring buffer.
+    */
+    uint64_t resample_period;
+    uint64_t resample_step;
+    uint32_t target_fill;
 
     struct fifo fifos[2];
     struct wave wave;
+    struct psg_channel psg[PSG_MAX];
+    struct sweep sweep;
+    uint32_t sequencer_step;
 
     struct {
         int16_t fifo[2];
-        int16_t wave;
     } latch;
 
-    pthread_mutex_t frontend_channels_mutex;
+    /*
+    ** The FIFOs fed by each timer (bit 0 for FIFO A, bit 1 for FIFO B), derived from
+    ** `REG_SOUNDCNT_H` and `REG_SOUNDCNT_X` so timer overflows don't have to decode them.
+    */
+    uint8_t timer_fifos[2];
+
+    /*
+    ** Instead of computing each output sample when it's due, changes to the mixer's inputs are
+    ** logged with their timestamp and the output is synthesized in blocks, once per frame or when
+    ** the log is full.
+    */
+    struct {
+        struct apu_mixer_input input;       // The inputs in effect at `cursor`
+        uint64_t cursor;                    // Everything before that point has been mixed
+        struct apu_change log[APU_CHANGE_LOG_CAPACITY];
+        size_t log_len;
+        struct apu_psg_generator generators[PSG_MAX];
+        struct apu_wave_generator wave;
+    } mixer;
+
+    struct apu_blip blip;
+
     struct apu_rbuffer frontend_channels;
+
+    struct apu_stretch stretch;
+
+    struct apu_recorder recorder;
 };
 
 /* gba/apu/apu.c */
 void apu_init(struct gba *gba);
 void apu_reset_fifo(struct gba *gba, enum fifo_idx fifo_idx);
+void apu_fifo_write32(struct gba *gba, enum fifo_idx fifo_idx, uint32_t val);
 void apu_fifo_write8(struct gba *gba, enum fifo_idx fifo_idx, uint8_t val);
-uint32_t apu_rbuffer_pop(struct apu_rbuffer *rbuffer);
+void apu_update_timer_fifos(struct gba *gba);
 void apu_on_timer_overflow(struct gba *gba, uint32_t timer_id);
+void apu_log_change(struct gba *gba);
+void apu_mixer_reset(struct gba *gba);
+void apu_flush(struct gba *gba);
+
+/* gba/apu/blip.c */
+void apu_blip_build_kernels(void);
+void apu_blip_reset(struct gba *gba, uint64_t cycles, uint32_t frame);
+void apu_blip_emit(struct gba *gba, uint64_t cycles);
+void apu_blip_add_step(struct gba *gba, uint64_t cycles, uint32_t frame);
+
+/* gba/apu/psg.c */
+void apu_psg_build_tables(void);
+void apu_psg_init(struct gba *gba);
+void apu_tone_reset(struct gba *gba, enum psg_idx idx);
+void apu_noise_reset(struct gba *gba);
+void apu_psg_stop(struct gba *gba, enum psg_idx idx);
+void apu_psg_length(struct gba *gba);
+void apu_psg_sweep(struct gba *gba);
+void apu_psg_envelope(struct gba *gba);
+void apu_psg_capture(struct gba const *gba, enum psg_idx idx, struct apu_psg_input *input);
+void apu_psg_reset_generator(struct apu_psg_generator *gen, enum psg_idx idx, struct apu_psg_input const *input, uint64_t cycles);
+void apu_psg_update_generator(struct apu_psg_generator *gen, enum psg_idx idx, struct apu_psg_input const *old, struct apu_psg_input const *new, uint64_t cycles);
+uint64_t apu_psg_next_edge(struct apu_psg_generator const *gen, enum psg_idx idx, struct apu_psg_input const *input);
+void apu_psg_advance(struct apu_psg_generator *gen, enum psg_idx idx, struct apu_psg_input const *input, uint64_t until);
+int16_t apu_psg_output(struct apu_psg_generator const *gen, struct apu_psg_input const *input);
+
+/* gba/apu/rbuffer.c */
+void apu_rbuffer_init(struct apu_rbuffer *rbuffer);
+size_t apu_rbuffer_push(struct apu_rbuffer *rbuffer, uint32_t const *frames, size_t count);
+size_t apu_rbuffer_pop(struct apu_rbuffer *rbuffer, uint32_t *frames, size_t count);
+size_t apu_rbuffer_fill(struct apu_rbuffer *rbuffer);
+void apu_rbuffer_wait_space(struct apu_rbuffer *rbuffer, size_t fill);
+
+/* gba/apu/recorder.c */
+bool apu_recorder_start(struct gba *gba, char const *path, char const *sources_path, enum apu_record_format format);
+void apu_recorder_stop(struct gba *gba);
+void apu_recorder_push_frames(struct gba *gba, uint32_t const *frames, size_t count);
+void apu_recorder_update_levels(struct gba *gba);
+
+/* gba/apu/stretch.c */
+void apu_stretch_reset(struct gba *gba);
+void apu_stretch_update(struct gba *gba);
+void apu_stretch_push(struct gba *gba, uint32_t const *frames, size_t count);
 
 /* gba/apu/wave.c */
-void apu_wave_init(struct gba *);
+void apu_wave_init(struct gba *gba);
 void apu_wave_reset(struct gba *gba);
 void apu_wave_stop(struct gba *gba);
+uint32_t apu_wave_bank(struct gba const *gba);
+void apu_wave_sync(struct gba *gba);
+void apu_wave_capture(struct gba const *gba, struct apu_wave_input *input);
+void apu_wave_reset_generator(struct gba const *gba, struct apu_wave_generator *gen, struct apu_wave_input const *input, uint64_t cycles);
+void apu_wave_update_generator(struct apu_wave_generator *gen, struct apu_wave_input const *input, uint64_t cycles);
+void apu_wave_step(struct apu_wave_generator *gen, struct apu_wave_input const *input);
+void apu_wave_advance(struct apu_wave_generator *gen, struct apu_wave_input const *input, uint64_t until);
 
 #endif /* !GBA_APU_H */
@@ -40,6 +40,21 @@ enum device_states {
     DEVICE_DISABLED,
 };
 
+/*
+** Frame skip policy that renders as many frames as the display can show,
+** based on the emulation speed.
+*/
+# define FRAME_SKIP_AUTO            (-1)
+
+/*
+** When the speed is unbounded, the maximum number of frames in a row `FRAME_SKIP_AUTO` skips if the
+** frontend doesn't ask for a new one.
+*/
+# define FRAME_SKIP_AUTO_MAX        15
+
+/* Number of messages the message queue can hold. Must be a power of two. */
+# define GBA_MESSAGE_QUEUE_CAPACITY 256
+
 enum message_types {
     MESSAGE_EXIT,
     MESSAGE_BIOS,
@@ -54,7 +69,13 @@ enum message_types {
     MESSAGE_QUICKLOAD,
     MESSAGE_QUICKSAVE,
     MESSAGE_AUDIO_RESAMPLE_FREQ,
+    MESSAGE_AUDIO_RECORD_START,
+    MESSAGE_AUDIO_RECORD_STOP,
     MESSAGE_SETTINGS_COLOR_CORRECTION,
+    MESSAGE_SETTINGS_THREADED_RENDERING,
+    MESSAGE_SETTINGS_FRAME_SKIP,
+    MESSAGE_SETTINGS_AUDIO_MASTER,
+    MESSAGE_SETTINGS_TIME_STRETCH,
     MESSAGE_SETTINGS_RTC,
 #ifdef WITH_DEBUGGER
     MESSAGE_DBG_FRAME,
@@ -113,7 +134,15 @@ struct message_data {
 
 struct message_audio_freq {
     struct message super;
-    uint64_t resample_frequency;
+    uint32_t sample_rate;       // In Hz
+    uint32_t buffer_size;       // The size of the audio device's buffer, in frames
+};
+
+struct message_audio_record {
+    struct message super;
+    char *path;
+    char *sources_path;         // NULL to not record each source separately
+    enum apu_record_format format;
 };
 
 struct message_color_correction {
@@ -121,6 +150,26 @@ struct message_color_correction {
     bool color_correction;
 };
 
+struct message_threaded_rendering {
+    struct message super;
+    bool threaded_rendering;
+};
+
+struct message_frame_skip {
+    struct message super;
+    int32_t frame_skip; // N > 0 renders one frame out of N + 1, or FRAME_SKIP_AUTO.
+};
+
+struct message_audio_master {
+    struct message super;
+    bool audio_master;
+};
+
+struct message_time_stretch {
+    struct message super;
+    bool time_stretch;
+};
+
 struct message_device_state {
     struct message super;
     enum device_states state;
@@ -157,17 +206,91 @@ struct message_dbg_watchpoints {
 
 #endif
 
+/*
+** Any message, used to size the slots of the message queue.
+**
+** Messages must have a fixed size: variable-size payloads (like the ROM's content) are allocated
+** on the side and only their address goes through the queue.
+*/
+union message_any {
+    struct message super;
+    struct message_keyinput keyinput;
+    struct message_backup_type backup_type;
+    struct message_speed speed;
+    struct message_reset reset;
+    struct message_data data;
+    struct message_audio_freq audio_freq;
+    struct message_audio_record audio_record;
+    struct message_color_correction color_correction;
+    struct message_threaded_rendering threaded_rendering;
+    struct message_frame_skip frame_skip;
+    struct message_audio_master audio_master;
+    struct message_time_stretch time_stretch;
+    struct message_device_state device_state;
+#ifdef WITH_DEBUGGER
+    struct message_dbg_trace dbg_trace;
+    struct message_dbg_step dbg_step;
+    struct message_dbg_breakpoints dbg_breakpoints;
+    struct message_dbg_watchpoints dbg_watchpoints;
+#endif
+};
+
+struct message_slot {
+    /*
+    ** `index` when the slot is free for the message `index`, `index + 1` once that message
+    ** is written and `index + GBA_MESSAGE_QUEUE_CAPACITY` once it's read.
+    */
+    atomic_size_t sequence;
+    union message_any message;
+};
+
+/*
+** The message queue: a bounded multiple-producer/single-consumer ring buffer, the emulation
+** thread being the only consumer (see `gba_message_push()`).
+**
+** The mutex and the condition variable are only used to wake up the emulation thread when it's
+** paused and waiting for a message.
+*/
 struct message_queue {
-    struct message *messages;
-    size_t length;
-    size_t allocated_size;
+    struct message_slot slots[GBA_MESSAGE_QUEUE_CAPACITY];
+
+    atomic_size_t write_idx;
+    uint8_t _pad0[CACHE_LINE_SIZE];
 
+    size_t read_idx;                    // Consumer's side
+    uint8_t _pad1[CACHE_LINE_SIZE];
+
+    atomic_bool waiting;
     pthread_mutex_t lock;
     pthread_cond_t ready;
 };
 
 struct game_entry;
 
+/*
+** State of the frame limiter of the emulation thread.
+**
+** All durations are in nanoseconds.
+*/
+# define FRAME_PACER_MIN_SPIN           (20 * 1000)
+# define FRAME_PACER_MAX_SPIN           (2 * 1000 * 1000)
+# define FRAME_PACER_MAX_LATE           4
+# define FRAME_PACER_REPORT_FRAMES      60
+
+struct frame_pacer {
+    uint64_t time_per_frame;
+    uint64_t deadline;
+
+    /* How long we spin before each deadline, and how much the OS oversleeps (smoothed) */
+    uint64_t spin;
+    uint64_t oversleep;
+
+    /* Pacing error accumulated since the last report */
+    uint64_t error_sum;
+    uint64_t error_max;
+    uint32_t error_count;
+};
+
 struct gba {
     enum gba_states state;
     uint32_t speed;
@@ -193,6 +316,33 @@ struct gba {
     /* Stores if color correction is enabled. */
     bool color_correction;
 
+    /* The thread scanlines are rendered on, if threaded rendering is enabled. */
+    struct ppu_render_thread render_thread;
+
+    /* The inputs of each scanline of each framebuffer, used to avoid rendering identical scanlines again. */
+    struct scanline_inputs scanlines_inputs[3][GBA_SCREEN_HEIGHT];
+
+    /* The mosaic lookup tables, derived from REG_MOSAIC. */
+    struct ppu_mosaic mosaic;
+
+    /*
+    ** The frame skip policy (see `struct message_frame_skip`) and its state.
+    **
+    ** Skipped frames are fully emulated but aren't rendered.
+    */
+    int32_t frame_skip;
+    bool skip_frame;
+    uint32_t skipped_frames;
+
+    // Set by the frontend when it picked up the last frame published, see `gba_framebuffer_acquire()`.
+    atomic_bool frame_requested;
+
+    /*
+    ** If set, and the emulator runs at normal speed, the emulation is paced by the audio device
+    ** (by waiting for room in the audio ring buffer) instead of the frame limiter.
+    */
+    bool audio_master;
+
     /* Stores the RTC-related settimgs */
     bool rtc_auto_detect;
     bool rtc_enabled;
@@ -200,12 +350,37 @@ struct gba {
     /* The message queue used by the frontend to communicate with the emulator. */
     struct message_queue message_queue;
 
-    /* The emulator's screen as it is being rendered. */
-    uint32_t framebuffer[GBA_SCREEN_WIDTH * GBA_SCREEN_HEIGHT];
-
-    /* The emulator's screen, refreshed each frame, used by the frontend */
-    uint32_t framebuffer_frontend[GBA_SCREEN_WIDTH * GBA_SCREEN_HEIGHT];
-    pthread_mutex_t framebuffer_frontend_mutex;
+    /*
+    ** The emulator's screen, triple-buffered.
+    **
+    ** The PPU renders in `framebuffers[framebuffer_back]`. When a frame is complete, it is published by
+    ** swapping `framebuffer_back` with `framebuffer_ready`, which also holds a sequence number in its upper bits.
+    ** The frontend then swaps `framebuffer_ready` with `framebuffer_front` to get the latest frame, see
+    ** `gba_framebuffer_acquire()`.
+    **
+    ** No lock is taken and no copy is made on either side.
+    */
+    uint32_t framebuffers[3][GBA_SCREEN_WIDTH * GBA_SCREEN_HEIGHT];
+    atomic_uint framebuffer_ready;
+
+    uint32_t framebuffer_back;              // Emulator's side
+    uint32_t framebuffer_seq;               // Emulator's side
+
+    uint32_t framebuffer_front;             // Frontend's side
+    uint32_t framebuffer_front_seq;         // Frontend's side
+
+    /*
+    ** Optional callback called by the emulation thread every time a new frame is published.
+    ** Set by the frontend before the emulation thread is started.
+    */
+    void (*frame_callback)(void *);
+    void *frame_callback_arg;
+
+    /* Average and maximum difference, in microseconds, between the frame deadlines and when they were actually met. */
+    struct {
+        atomic_uint avg;
+        atomic_uint max;
+    } pacing_error;
 
     /* The frame counter, used for FPS calculations. */
     atomic_uint framecounter;
@@ -214,6 +389,7 @@ struct gba {
 /* gba/gba.c */
 void gba_init(struct gba *gba);
 void gba_main_loop(struct gba *gba);
+uint32_t const *gba_framebuffer_acquire(struct gba *gba, uint32_t *seq);
 void gba_send_exit(struct gba *gba);
 void gba_send_bios(struct gba *gba, uint8_t *data, void (*cleanup)(void *));
 void gba_send_rom(struct gba *gba, uint8_t *data, size_t size, void (*cleanup)(void *));
@@ -226,8 +402,14 @@ void gba_send_pause(struct gba *gba);
 void gba_send_keyinput(struct gba *gba, enum keyinput key, bool pressed);
 void gba_send_quickload(struct gba *gba, char const *path);
 void gba_send_quicksave(struct gba *gba, char const *path);
-void gba_send_audio_resample_freq(struct gba *gba, uint64_t resample_freq);
+void gba_send_audio_resample_freq(struct gba *gba, uint32_t sample_rate, uint32_t buffer_size);
+void gba_send_audio_record_start(struct gba *gba, char const *path, char const *sources_path, enum apu_record_format format);
+void gba_send_audio_record_stop(struct gba *gba);
 void gba_send_settings_color_correction(struct gba *gba, bool color_correction);
+void gba_send_settings_threaded_rendering(struct gba *gba, bool threaded_rendering);
+void gba_send_settings_frame_skip(struct gba *gba, int32_t frame_skip);
+void gba_send_settings_audio_master(struct gba *gba, bool audio_master);
+void gba_send_settings_time_stretch(struct gba *gba, bool time_stretch);
 void gba_send_settings_rtc(struct gba *gba, enum device_states state);
 
 #ifdef WITH_DEBUGGER
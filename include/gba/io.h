@@ -488,6 +488,43 @@ struct io {
         uint8_t bytes[2];
     } bldy;
 
+    // REG_SOUND1CNT_L
+    union {
+        struct {
+            uint16_t sweep_shift: 3;
+            uint16_t sweep_direction: 1;
+            uint16_t sweep_time: 3;
+            uint16_t : 9;
+        } __packed;
+        uint16_t raw;
+        uint8_t bytes[2];
+    } sound1cnt_l;
+
+    // REG_SOUND1CNT_H and REG_SOUND2CNT_L
+    union {
+        struct {
+            uint16_t length: 6;
+            uint16_t duty: 2;
+            uint16_t envelope_step_time: 3;
+            uint16_t envelope_direction: 1;
+            uint16_t envelope_volume: 4;
+        } __packed;
+        uint16_t raw;
+        uint8_t bytes[2];
+    } tone_duty[2];
+
+    // REG_SOUND1CNT_X and REG_SOUND2CNT_H
+    union {
+        struct {
+            uint16_t frequency: 11;
+            uint16_t : 3;
+            uint16_t use_length: 1;
+            uint16_t reset: 1;
+        } __packed;
+        uint16_t raw;
+        uint8_t bytes[2];
+    } tone_freq[2];
+
     // REG_SOUND3CNT_L
     union {
         struct {
@@ -525,6 +562,33 @@ struct io {
         uint8_t bytes[2];
     } sound3cnt_x;
 
+    // REG_SOUND4CNT_L
+    union {
+        struct {
+            uint16_t length: 6;
+            uint16_t : 2;
+            uint16_t envelope_step_time: 3;
+            uint16_t envelope_direction: 1;
+            uint16_t envelope_volume: 4;
+        } __packed;
+        uint16_t raw;
+        uint8_t bytes[2];
+    } sound4cnt_l;
+
+    // REG_SOUND4CNT_H
+    union {
+        struct {
+            uint16_t ratio: 3;
+            uint16_t width: 1;
+            uint16_t shift: 4;
+            uint16_t : 6;
+            uint16_t use_length: 1;
+            uint16_t reset: 1;
+        } __packed;
+        uint16_t raw;
+        uint8_t bytes[2];
+    } sound4cnt_h;
+
     // REG_SOUNDCNT_L
     union {
         struct {
@@ -746,9 +810,14 @@ static_assert(sizeof(((struct io *)NULL)->mosaic) == sizeof(uint32_t));
 static_assert(sizeof(((struct io *)NULL)->bldcnt) == sizeof(uint16_t));
 static_assert(sizeof(((struct io *)NULL)->bldalpha) == sizeof(uint16_t));
 static_assert(sizeof(((struct io *)NULL)->bldy) == sizeof(uint16_t));
+static_assert(sizeof(((struct io *)NULL)->sound1cnt_l) == sizeof(uint16_t));
+static_assert(sizeof(((struct io *)NULL)->tone_duty) == 2 * sizeof(uint16_t));
+static_assert(sizeof(((struct io *)NULL)->tone_freq) == 2 * sizeof(uint16_t));
 static_assert(sizeof(((struct io *)NULL)->sound3cnt_l) == sizeof(uint16_t));
 static_assert(sizeof(((struct io *)NULL)->sound3cnt_h) == sizeof(uint16_t));
 static_assert(sizeof(((struct io *)NULL)->sound3cnt_x) == sizeof(uint16_t));
+static_assert(sizeof(((struct io *)NULL)->sound4cnt_l) == sizeof(uint16_t));
+static_assert(sizeof(((struct io *)NULL)->sound4cnt_h) == sizeof(uint16_t));
 static_assert(sizeof(((struct io *)NULL)->soundcnt_l) == sizeof(uint16_t));
 static_assert(sizeof(((struct io *)NULL)->soundcnt_h) == sizeof(uint16_t));
 static_assert(sizeof(((struct io *)NULL)->soundcnt_x) == sizeof(uint16_t));
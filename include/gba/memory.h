@@ -12,6 +12,7 @@
 
 # include <stdint.h>
 # include "hades.h"
+# include "gba/ppu.h"
 
 /*
 ** Access to the memory bus can either be sequential (the requested address follows the previous one)
@@ -56,6 +57,8 @@ enum access_types {
 #define PALRAM_REGION           (PALRAM_START >> 24)
 #define PALRAM_MASK             (PALRAM_END - PALRAM_START)
 #define PALRAM_SIZE             (PALRAM_END - PALRAM_START + 1)
+#define PALRAM_GEN_BANK_SIZE    (32)
+#define PALRAM_GEN_BANK_COUNT   (PALRAM_SIZE / PALRAM_GEN_BANK_SIZE)
 
 #define VRAM_START              (0x06000000)
 #define VRAM_END                (0x06017FFF)
@@ -63,6 +66,10 @@ enum access_types {
 #define VRAM_MASK_1             (0x00017FFF)
 #define VRAM_MASK_2             (0x0001FFFF)
 #define VRAM_SIZE               (VRAM_END - VRAM_START + 1)
+#define VRAM_TILE4_SIZE         (32)
+#define VRAM_TILE4_COUNT        (VRAM_SIZE / VRAM_TILE4_SIZE)
+#define VRAM_GEN_BLOCK_SIZE     (0x800)
+#define VRAM_GEN_BLOCK_COUNT    (VRAM_SIZE / VRAM_GEN_BLOCK_SIZE)
 
 #define OAM_START               (0x07000000)
 #define OAM_END                 (0x070003FF)
@@ -216,6 +223,38 @@ struct memory {
     uint8_t vram[VRAM_SIZE];
     uint8_t oam[OAM_SIZE];
 
+    /*
+    ** Caches derived from the display memory.
+    **
+    ** They aren't part of the emulated state and are rebuilt lazily by the PPU
+    ** when the memory they are derived from is written to.
+    */
+
+    // VRAM seen as 4bpp tiles, expanded to one byte per pixel.
+    uint8_t vram_tiles[VRAM_TILE4_COUNT][64];
+    uint64_t vram_tiles_dirty[VRAM_TILE4_COUNT / 64];
+
+    /*
+    ** OAM decoded into a list of sprites and, for each scanline, a bitmask of the sprites covering it.
+    **
+    ** Rebuilt by the PPU before rendering a scanline if the generation of the OAM it is rendered with
+    ** (see `oam_gen` below) isn't `oam_sprites_gen`.
+    */
+    struct sprite oam_sprites[128];
+    uint64_t oam_sprites_per_line[GBA_SCREEN_HEIGHT][2];
+    uint64_t oam_sprites_gen;
+
+    /*
+    ** Generation of each 2KB block of VRAM, of each 16-colors bank of PALRAM and of OAM.
+    **
+    ** Each time one of them is modified, it's stamped with the next value of `display_gen`,
+    ** so the last modification of a set of them is the highest generation of that set.
+    */
+    uint64_t display_gen;
+    uint64_t vram_gen[VRAM_GEN_BLOCK_COUNT];
+    uint64_t palram_gen[PALRAM_GEN_BANK_COUNT];
+    uint64_t oam_gen;
+
     // External Memory (Game Pak)
     uint8_t rom[CART_SIZE];
     size_t rom_size;
@@ -269,6 +308,7 @@ void mem_io_write8(struct gba *gba, uint32_t addr, uint8_t val);
 
 /* gba/memory/memory.c */
 void mem_reset(struct memory *memory);
+void mem_invalidate_display_caches(struct memory *memory);
 void mem_access(struct gba *gba, uint32_t addr, uint32_t size, enum access_types access_type);
 void mem_update_waitstates(struct gba const *gba);
 void mem_prefetch_buffer_access(struct gba *gba, uint32_t addr, uint32_t intended_cycles);
@@ -321,4 +361,22 @@ void quickload(struct gba *gba, char const *);
 # define mem_vram_read16(gba, addr)         (*(uint16_t *)((uint8_t *)(gba)->memory.vram + ((addr) & (((addr) & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2))))
 # define mem_oam_read16(gba, addr)          (*(uint16_t *)((uint8_t *)(gba)->memory.oam + ((addr) & OAM_MASK)))
 
+/*
+** Return the offset within `memory.vram` that the given VRAM address maps to, taking mirrors into account.
+*/
+# define mem_vram_offset(addr)              ((addr) & (((addr) & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2))
+
+/*
+** Mark the 4bpp tile containing the byte at the given offset within `memory.vram` as outdated.
+*/
+# define mem_vram_invalidate_tile(gba, off) ((gba)->memory.vram_tiles_dirty[(off) / (64 * VRAM_TILE4_SIZE)] |= (1ull << (((off) / VRAM_TILE4_SIZE) % 64)))
+
+/*
+** Stamp the block of VRAM containing the byte at the given offset within `memory.vram`, the bank of PALRAM
+** containing the given address or OAM with a new generation.
+*/
+# define mem_vram_touch(gba, off)           ((gba)->memory.vram_gen[(off) / VRAM_GEN_BLOCK_SIZE] = ++(gba)->memory.display_gen)
+# define mem_palram_touch(gba, addr)        ((gba)->memory.palram_gen[((addr) & PALRAM_MASK) / PALRAM_GEN_BANK_SIZE] = ++(gba)->memory.display_gen)
+# define mem_oam_touch(gba)                 ((gba)->memory.oam_gen = ++(gba)->memory.display_gen)
+
 #endif /* !GBA_MEMORY_H */
@@ -10,7 +10,9 @@
 #ifndef GBA_PPU_H
 # define GBA_PPU_H
 
+# include <stddef.h>
 # include "hades.h"
+# include "gba/io.h"
 
 # define GBA_SCREEN_WIDTH           240
 # define GBA_SCREEN_HEIGHT          160
@@ -62,11 +64,31 @@ struct rich_color {
 } __packed;
 
 struct scanline {
+    /*
+    ** The inputs of the scanline, captured when it is scheduled for rendering so that it
+    ** can be rendered while the emulation carries on.
+    */
+    struct io io;
+    uint32_t y;
+    int32_t internal_px[2];
+    int32_t internal_py[2];
+
+    /*
+    ** The content of PALRAM and OAM the scanline is rendered with, and the generation of the latter.
+    **
+    ** They point to the emulated memory itself unless the scanline is queued for the render thread,
+    ** in which case they point to a copy taken along with the other inputs.
+    */
+    uint8_t const *palram_data;
+    uint8_t const *oam_data;
+    uint64_t oam_gen;
+
     struct rich_color bot[GBA_SCREEN_WIDTH];
     struct rich_color bg[GBA_SCREEN_WIDTH];
     struct rich_color oam[4][GBA_SCREEN_WIDTH];
     struct rich_color result[GBA_SCREEN_WIDTH];
     bool win_obj_mask[GBA_SCREEN_WIDTH];
+    uint8_t win_opts[GBA_SCREEN_WIDTH];     // WININ/WINOUT settings of the top-most window of each pixel
     uint32_t top_idx;
 };
 
@@ -118,6 +140,29 @@ union oam_entry {
 
 static_assert(sizeof(union oam_entry) == 3 * sizeof(uint16_t));
 
+/*
+** An OAM entry, decoded with everything that doesn't depend on the scanline being rendered.
+*/
+struct sprite {
+    union oam_entry oam;
+
+    // Position and size of the sprite's window on screen
+    int32_t win_ox;
+    int32_t win_oy;
+    int32_t win_sx;
+    int32_t win_sy;
+
+    // Size of the sprite itself
+    int32_t sprite_sx;
+    int32_t sprite_sy;
+
+    // Affine matrix (identity for non-affine sprites)
+    int16_t pa;
+    int16_t pb;
+    int16_t pc;
+    int16_t pd;
+};
+
 struct ppu {
     // Internal registers used for affine backgrounds
     int32_t internal_px[2];
@@ -125,17 +170,134 @@ struct ppu {
 
     // Set when the registers above must be reloaded at the next H-Draw.
     bool reload_internal_affine_regs;
+};
+
+/*
+** Map a screen coordinate to the one of the first pixel of its mosaic block.
+**
+** Derived from REG_MOSAIC and rebuilt by `ppu_update_mosaic()` before rendering a scanline with a
+** different value of that register than the one they were built for.
+*/
+struct ppu_mosaic {
+    uint32_t raw;
+    uint8_t bg_y[GBA_SCREEN_HEIGHT];
+    uint8_t obj_x[GBA_SCREEN_WIDTH];
+    uint8_t obj_y[GBA_SCREEN_HEIGHT];
+};
+
+/*
+** Everything the rendering of a scanline depends on.
+**
+** If these are the same than the ones of the scanline rendered at the same position during the
+** previous frame, the content of the framebuffer for that line can be kept as-is.
+*/
+struct scanline_inputs {
+    bool valid;
+    bool color_correction;
+    uint16_t dispcnt;
+
+    // All the IO registers from REG_BG0CNT to REG_BLDY
+    uint8_t io[offsetof(struct io, bldy) + sizeof(((struct io *)NULL)->bldy) - offsetof(struct io, bgcnt)];
+
+    int32_t internal_px[2];
+    int32_t internal_py[2];
 
-    bool win_masks[2][GBA_SCREEN_WIDTH];
-    uint32_t win_masks_hash[2];                /* The min/max for that windows. Kept to avoid rebuilding the mask across scanlines. */
+    // The highest generation of the blocks of VRAM and the banks of PALRAM the scanline reads, and of OAM.
+    uint64_t vram_gen;
+    uint64_t palram_gen;
+    uint64_t oam_gen;
 };
 
+# define PPU_RENDER_QUEUE_SIZE          16
+# define PPU_RENDER_SPIN_COUNT          1024
+
+struct ppu_render_job;
+
+/*
+** A thread scanlines can be rendered on, in parallel to the emulation.
+**
+** Scanlines are queued in `jobs`, which is a ring buffer of `PPU_RENDER_QUEUE_SIZE` entries indexed
+** by `write_idx` (owned by the emulation) and `read_idx` (owned by the render thread).
+**
+** PALRAM and OAM are copied along with the other inputs of a scanline, but VRAM is too big for that:
+** the emulation must call `ppu_render_sync_vram()` before modifying it, and `ppu_render_sync()`
+** before modifying anything else a queued scanline could read (the framebuffer, the mosaic tables...).
+**
+** The former also covers `memory.vram_tiles_dirty`, which words match the blocks of VRAM.
+*/
+struct ppu_render_thread {
+    bool enabled;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    bool exit;
+
+    struct ppu_render_job *jobs;
+    uint8_t _pad0[CACHE_LINE_SIZE];
+
+    // Emulation's side
+    atomic_uint write_idx;
+    uint64_t vram_blocks;               // A superset of the blocks of VRAM read by the queued scanlines
+    uint8_t _pad1[CACHE_LINE_SIZE];
+
+    // Render thread's side
+    atomic_uint read_idx;
+    atomic_bool sleeping;               // Set while the render thread is, or is about to be, waiting on `ready`
+    uint8_t _pad2[CACHE_LINE_SIZE];
+};
+
+/*
+** Wait for all the scanlines queued for the render thread, if any, to be rendered.
+*/
+# define ppu_render_sync(gba)                                                                   \
+    do {                                                                                        \
+        uint32_t _write_idx;                                                                    \
+                                                                                                \
+        _write_idx = atomic_load_explicit(&(gba)->render_thread.write_idx, memory_order_relaxed); \
+        if (unlikely(atomic_load_explicit(&(gba)->render_thread.read_idx, memory_order_acquire) != _write_idx)) { \
+            ppu_render_thread_wait((gba), _write_idx);                                          \
+        }                                                                                       \
+    } while (0)
+
+/*
+** Wait for the scanlines queued for the render thread reading the block of VRAM containing the byte at
+** the given offset within `memory.vram`, if any, to be rendered.
+*/
+# define ppu_render_sync_vram(gba, off)                                                         \
+    do {                                                                                        \
+        if (unlikely((gba)->render_thread.vram_blocks & (1ull << ((off) / VRAM_GEN_BLOCK_SIZE)))) { \
+            ppu_render_thread_wait_vram((gba), (off) / VRAM_GEN_BLOCK_SIZE);                    \
+        }                                                                                       \
+    } while (0)
+
+/*
+** Read the content of PALRAM or OAM a scanline is rendered with.
+*/
+# define ppu_palram_read16(scanline, addr)  (*(uint16_t const *)((scanline)->palram_data + ((addr) & PALRAM_MASK)))
+# define ppu_oam_read16(scanline, addr)     (*(uint16_t const *)((scanline)->oam_data + ((addr) & OAM_MASK)))
+
+/*
+** Return the 64 pixels (one palette index per byte) of the 4bpp tile starting at the given offset within
+** `memory.vram`, decoding it first if it was modified since it was last used.
+*/
+# define ppu_tile4_pixels(gba, off)                                                             \
+    ({                                                                                          \
+        uint32_t _idx;                                                                          \
+                                                                                                \
+        _idx = (off) / VRAM_TILE4_SIZE;                                                         \
+        unlikely((gba)->memory.vram_tiles_dirty[_idx / 64] & (1ull << (_idx % 64)))            \
+            ? ppu_decode_tile4((gba), _idx)                                                     \
+            : (uint8_t const *)(gba)->memory.vram_tiles[_idx]                                   \
+        ;                                                                                       \
+    })
+
 /* gba/ppu/background/bitmap.c */
 void ppu_render_background_bitmap(struct gba const *gba, struct scanline *scanline, bool palette);
 void ppu_render_background_bitmap_small(struct gba const *gba, struct scanline *scanline);
 
 /* gba/ppu/background/text.c */
-void ppu_render_background_text(struct gba const *gba, struct scanline *scanline, uint32_t line, uint32_t bg_idx);
+void ppu_render_background_text(struct gba *gba, struct scanline *scanline, uint32_t line, uint32_t bg_idx);
 
 /* gba/ppu/background/affine.c */
 void ppu_render_background_affine(struct gba *gba, struct scanline *scanline, uint32_t line, uint32_t bg_idx);
@@ -146,11 +308,16 @@ void ppu_step_affine_internal_registers(struct gba *gba);
 void ppu_prerender_oam(struct gba *gba, struct scanline *scanline, int32_t line);
 
 /* gba/ppu/ppu.c */
+void ppu_build_color_luts(void);
 void ppu_init(struct gba *);
+uint8_t const *ppu_decode_tile4(struct gba *gba, uint32_t tile_idx);
+void ppu_update_mosaic(struct gba *gba, struct io const *io);
+void ppu_set_threaded_rendering(struct gba *gba, bool enable);
+void ppu_render_thread_wait(struct gba *gba, uint32_t idx);
+void ppu_render_thread_wait_vram(struct gba *gba, uint32_t block);
 void ppu_render_black_screen(struct gba *gba);
 
 /* gba/ppu/window.c */
-void ppu_window_build_masks(struct gba *gba, uint32_t y);
-uint8_t ppu_find_top_window(struct gba const *gba, struct scanline const *, uint32_t x);
+void ppu_window_build_masks(struct gba const *gba, struct scanline *scanline, uint32_t y);
 
 #endif /* !GBA_PPU_H */
@@ -14,6 +14,8 @@
 
 typedef size_t event_handler_t;
 
+struct gba;
+
 enum sched_event_kind {
     EVENT_HBLANK,
     EVENT_HDRAW,
@@ -25,11 +25,15 @@ void gui_sdl_cleanup(struct app *app);
 /* gui/sdl/input.c */
 void gui_sdl_setup_default_binds(struct app *app);
 void gui_sdl_handle_inputs(struct app *app);
+void gui_sdl_wait_events(struct app *app, uint32_t timeout);
+void gui_sdl_handle_inputs_until(struct app *app, uint64_t deadline);
+void gui_sdl_frame_callback(void *raw_app);
 
 /* gui/sdl/video.c */
 void gui_sdl_video_init(struct app *app);
 void gui_sdl_video_cleanup(struct app *app);
 void gui_sdl_video_render_frame(struct app *app);
+void gui_sdl_video_wait_present_deadline(struct app *app);
 
 /* gui/windows/keybinds.c */
 void gui_win_keybinds_editor(struct app *app);
@@ -115,6 +115,18 @@ static char const * const modules_str[] = {
 #  define max(a, b)                             ((a) > (b) ? (a) : (b))
 # endif /* !max */
 
+/* Hint the CPU that we are busy-waiting. */
+# if defined(__x86_64__) || defined(__i386__)
+#  define hs_pause()                            __builtin_ia32_pause()
+# elif defined(__aarch64__) || defined(__arm__)
+#  define hs_pause()                            __asm__ volatile("yield")
+# else
+#  define hs_pause()                            ((void)0)
+# endif
+
+/* Size of a cache line, used to keep the data written by different threads apart and avoid false sharing. */
+# define CACHE_LINE_SIZE                        64
+
 /* Return the size of static array */
 # define array_length(array)                    (sizeof(array) / sizeof(*(array)))
 
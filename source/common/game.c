@@ -259,6 +259,10 @@ app_game_reset(
     /* Misc. */
     gba_send_speed(app->emulation.gba, app->emulation.speed * !app->emulation.unbounded);
     gba_send_settings_color_correction(app->emulation.gba, app->video.color_correction);
+    gba_send_settings_threaded_rendering(app->emulation.gba, app->video.threaded_rendering);
+    gba_send_settings_frame_skip(app->emulation.gba, app->video.frame_skip);
+    gba_send_settings_audio_master(app->emulation.gba, app->audio.audio_master);
+    gba_send_settings_time_stretch(app->emulation.gba, app->audio.time_stretch);
 
     if (
            !app_game_load_bios(app)
@@ -410,16 +414,14 @@ app_game_screenshot(
     hs_mkdir("screenshots");
     strftime(filename, sizeof(filename), "screenshots/%Y-%m-%d_%Hh%Mm%Ss.png", now_info);
 
-    pthread_mutex_lock(&app->emulation.gba->framebuffer_frontend_mutex);
     out = stbi_write_png(
         filename,
         GBA_SCREEN_WIDTH,
         GBA_SCREEN_HEIGHT,
         4,
-        app->emulation.gba->framebuffer_frontend,
+        gba_framebuffer_acquire(app->emulation.gba, NULL),
         GBA_SCREEN_WIDTH * sizeof(uint32_t)
     );
-    pthread_mutex_unlock(&app->emulation.gba->framebuffer_frontend_mutex);
 
     if (out) {
         logln(
@@ -440,3 +442,50 @@ app_game_screenshot(
         );
     }
 }
+
+/*
+** Start recording the audio output in a new file of the `recordings` directory.
+**
+** If `app->audio.record_sources` is set, each source of the GBA's audio is also recorded
+** separately in a second file, one source per channel.
+**
+** The emulator sets `apu.recorder.recording` once the recording actually started.
+*/
+void
+app_game_record_audio(
+    struct app *app
+) {
+    time_t now;
+    struct tm *now_info;
+    char timestamp[64];
+    char filename[256];
+    char sources_filename[256];
+    char const *ext;
+
+    time(&now);
+    now_info = localtime(&now);
+
+    hs_mkdir("recordings");
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d_%Hh%Mm%Ss", now_info);
+
+    ext = (app->audio.record_format == APU_RECORD_WAV) ? "wav" : "raw";
+    snprintf(filename, sizeof(filename), "recordings/%s.%s", timestamp, ext);
+    snprintf(sources_filename, sizeof(sources_filename), "recordings/%s-sources.%s", timestamp, ext);
+
+    gba_send_audio_record_start(
+        app->emulation.gba,
+        filename,
+        app->audio.record_sources ? sources_filename : NULL,
+        app->audio.record_format
+    );
+}
+
+/*
+** Stop the audio recording in progress.
+*/
+void
+app_game_stop_audio_recording(
+    struct app *app
+) {
+    gba_send_audio_record_stop(app->emulation.gba);
+}
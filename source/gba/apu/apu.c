@@ -13,34 +13,48 @@
 #include "gba/scheduler.h"
 
 static void apu_sequencer(struct gba *gba, struct event_args args);
-static void apu_resample(struct gba *gba, struct event_args args);
+static void apu_mixer_capture(struct gba const *gba, struct apu_mixer_input *input);
+static uint32_t apu_mixer_frame(struct gba const *gba, struct apu_mixer_input const *input);
+static void apu_mix_frame(struct gba *gba, struct event_args args);
 
 void
 apu_init(
     struct gba *gba
 ) {
-    memset(gba->apu.fifos, 0, sizeof(gba->apu.fifos));
-    memset(&gba->apu.frontend_channels, 0, sizeof(gba->apu.frontend_channels));
+    size_t i;
 
-    pthread_mutex_init(&gba->apu.frontend_channels_mutex, NULL);
+    memset(gba->apu.fifos, 0, sizeof(gba->apu.fifos));
     apu_wave_init(gba);
+    apu_psg_init(gba);
+
+    memset(&gba->apu.mixer, 0, sizeof(gba->apu.mixer));
+    apu_mixer_capture(gba, &gba->apu.mixer.input);
+    for (i = 0; i < PSG_MAX; ++i) {
+        apu_psg_reset_generator(&gba->apu.mixer.generators[i], i, &gba->apu.mixer.input.psg[i], 0);
+    }
+    apu_wave_reset_generator(gba, &gba->apu.mixer.wave, &gba->apu.mixer.input.wave, 0);
+    apu_blip_reset(gba, 0, apu_mixer_frame(gba, &gba->apu.mixer.input));
+    apu_recorder_update_levels(gba);
+    apu_stretch_reset(gba);
+    apu_update_timer_fifos(gba);
 
     sched_add_event(
         gba,
         NEW_REPEAT_EVENT(
             0,
-            CYCLES_PER_SECOND / 256,
+            CYCLES_PER_SECOND / 512,
             apu_sequencer
         )
     );
 
-    if (gba->apu.resample_frequency) {
+    gba->apu.resample_step = gba->apu.resample_period;
+    if (gba->apu.resample_period) {
         sched_add_event(
             gba,
             NEW_REPEAT_EVENT(
-                0,
-                gba->apu.resample_frequency,
-                apu_resample
+                CYCLES_PER_FRAME,
+                CYCLES_PER_FRAME,
+                apu_mix_frame
             )
         );
     }
@@ -54,6 +68,29 @@ apu_reset_fifo(
     memset(&gba->apu.fifos[fifo_idx], 0, sizeof(gba->apu.fifos[0]));
 }
 
+/*
+** Push the four bytes of `val` in the given FIFO, least significant first.
+**
+** Equivalent to four calls to `apu_fifo_write8()`, used by Direct Sound DMAs.
+*/
+void
+apu_fifo_write32(
+    struct gba *gba,
+    enum fifo_idx fifo_idx,
+    uint32_t val
+) {
+    struct fifo *fifo;
+    size_t i;
+
+    fifo = &gba->apu.fifos[fifo_idx];
+
+    for (i = 0; i < sizeof(val) && fifo->size < FIFO_CAPACITY; ++i) {
+        fifo->data[fifo->write_idx] = (int8_t)(val >> (i * 8));
+        fifo->write_idx = (fifo->write_idx + 1) % FIFO_CAPACITY;
+        ++fifo->size;
+    }
+}
+
 void
 apu_fifo_write8(
     struct gba *gba,
@@ -91,36 +128,30 @@ apu_fifo_read8(
     return (val);
 }
 
-static
+/*
+** Update the FIFOs fed by each timer.
+**
+** Must be called after writing to `REG_SOUNDCNT_H` or `REG_SOUNDCNT_X`.
+*/
 void
-apu_rbuffer_push(
-    struct apu_rbuffer *rbuffer,
-    int16_t val_l,
-    int16_t val_r
+apu_update_timer_fifos(
+    struct gba *gba
 ) {
-    if (rbuffer->size < APU_RBUFFER_CAPACITY) {
-        uint32_t data;
+    struct io const *io;
+    size_t fifo_idx;
 
-        data = (((uint32_t)(uint16_t)val_l) << 16) | ((uint32_t)(uint16_t)val_r);
-        rbuffer->data[rbuffer->write_idx] = data;
-        rbuffer->write_idx = (rbuffer->write_idx + 1) % APU_RBUFFER_CAPACITY;
-        ++rbuffer->size;
-    }
-}
+    io = &gba->io;
 
-uint32_t
-apu_rbuffer_pop(
-    struct apu_rbuffer *rbuffer
-) {
-    uint32_t val;
+    gba->apu.timer_fifos[0] = 0;
+    gba->apu.timer_fifos[1] = 0;
 
-    val = rbuffer->data[rbuffer->read_idx];
-    if (rbuffer->size > 0) {
-        rbuffer->read_idx = (rbuffer->read_idx + 1) % APU_RBUFFER_CAPACITY;
-        --rbuffer->size;
+    if (!io->soundcnt_x.master_enable) {
+        return ;
     }
 
-    return (val);
+    for (fifo_idx = 0; fifo_idx < 2; ++fifo_idx) {
+        gba->apu.timer_fifos[bitfield_get(io->soundcnt_h.raw, 10 + fifo_idx * 4)] |= 1 << fifo_idx;
+    }
 }
 
 void
@@ -128,19 +159,19 @@ apu_on_timer_overflow(
     struct gba *gba,
     uint32_t timer_id
 ) {
-    struct io *io;
+    uint32_t fifos;
     size_t fifo_idx;
 
-    io = &gba->io;
+    fifos = gba->apu.timer_fifos[timer_id];
 
-    if (!io->soundcnt_x.master_enable) {
+    if (!fifos) {
         return;
     }
 
     for (fifo_idx = 0; fifo_idx < 2; ++fifo_idx) {
 
         // We are interested only in the FIFO synchronised with our timer
-        if (bitfield_get(io->soundcnt_h.raw, 10 + fifo_idx * 4) != timer_id) {
+        if (!(fifos & (1 << fifo_idx))) {
             continue;
         }
 
@@ -156,10 +187,15 @@ apu_on_timer_overflow(
             }
         }
     }
+
+    apu_log_change(gba);
 }
 
 /*
-** Called at a rate of 256Hz to handle the different modulation units (length, envelope and sweep)
+** The frame sequencer.
+**
+** Called at a rate of 512Hz to clock the different modulation units: the length counters at 256Hz,
+** the sweep at 128Hz and the envelopes at 64Hz.
 */
 static
 void
@@ -167,48 +203,121 @@ apu_sequencer(
     struct gba *gba,
     struct event_args args __unused
 ) {
-    /* Wave - Length */
-    if (gba->io.sound3cnt_l.enable && gba->io.sound3cnt_x.use_length && gba->apu.wave.length) {
-        --gba->apu.wave.length;
-        if (!gba->apu.wave.length) {
-            apu_wave_stop(gba);
+    uint32_t step;
+
+    step = gba->apu.sequencer_step;
+    gba->apu.sequencer_step = (step + 1) % 8;
+
+    if (!(step % 2)) {
+        /* Wave - Length */
+        if (gba->io.sound3cnt_l.enable && gba->io.sound3cnt_x.use_length && gba->apu.wave.length) {
+            --gba->apu.wave.length;
+            if (!gba->apu.wave.length) {
+                apu_wave_stop(gba);
+            }
         }
+
+        /* Tone & Noise - Length */
+        apu_psg_length(gba);
+    }
+
+    /* Tone - Sweep */
+    if (step == 2 || step == 6) {
+        apu_psg_sweep(gba);
+    }
+
+    /* Tone & Noise - Envelope */
+    if (step == 7) {
+        apu_psg_envelope(gba);
     }
 }
 
 /*
-** This function is called at the same frequency than the real hardware the emulator is running on (probably 48000Hz).
-**
-** The goal here is to feed `apu_rbuffer` with whatever sound the GBA would be playing at this time, which is contained in `gba->apu.latch`.
+** Return the current inputs of the mixer.
 */
 static
 void
-apu_resample(
-    struct gba *gba,
-    struct event_args args __unused
+apu_mixer_capture(
+    struct gba const *gba,
+    struct apu_mixer_input *input
+) {
+    size_t i;
+
+    memset(input, 0, sizeof(*input));
+    input->fifo[FIFO_A] = gba->apu.latch.fifo[FIFO_A];
+    input->fifo[FIFO_B] = gba->apu.latch.fifo[FIFO_B];
+    input->soundcnt_l = gba->io.soundcnt_l.raw;
+    input->soundcnt_h = gba->io.soundcnt_h.raw;
+    input->bias = gba->io.soundbias.bias;
+
+    for (i = 0; i < PSG_MAX; ++i) {
+        apu_psg_capture(gba, i, &input->psg[i]);
+    }
+
+    apu_wave_capture(gba, &input->wave);
+}
+
+/*
+** Compute the stereo frame the GBA outputs for the given inputs and the current output of the
+** mixer's PSG generators.
+*/
+static
+uint32_t
+apu_mixer_frame(
+    struct gba const *gba,
+    struct apu_mixer_input const *input
 ) {
     static int32_t fifo_volume[2] = {2, 4};
     static int32_t sound_volume[4] = {1, 2, 4, 0};
+    typeof(((struct io *)NULL)->soundcnt_l) soundcnt_l;
+    typeof(((struct io *)NULL)->soundcnt_h) soundcnt_h;
+    struct apu_psg_generator const *gens;
+    int32_t tone_1;
+    int32_t tone_2;
+    int32_t wave;
+    int32_t noise;
     int32_t sample_l;
     int32_t sample_r;
 
+    soundcnt_l.raw = input->soundcnt_l;
+    soundcnt_h.raw = input->soundcnt_h;
+
+    gens = gba->apu.mixer.generators;
+    tone_1 = apu_psg_output(&gens[PSG_TONE_1], &input->psg[PSG_TONE_1]);
+    tone_2 = apu_psg_output(&gens[PSG_TONE_2], &input->psg[PSG_TONE_2]);
+    noise = apu_psg_output(&gens[PSG_NOISE], &input->psg[PSG_NOISE]);
+    wave = gba->apu.mixer.wave.sample;
+
     sample_l = 0;
     sample_r = 0;
 
-    sample_l += (gba->apu.latch.wave * (bool)gba->io.soundcnt_l.enable_sound_3_left);
-    sample_r += (gba->apu.latch.wave * (bool)gba->io.soundcnt_l.enable_sound_3_right);
+    sample_l += (tone_1 * (bool)soundcnt_l.enable_sound_1_left);
+    sample_r += (tone_1 * (bool)soundcnt_l.enable_sound_1_right);
 
-    sample_l = sample_l * sound_volume[gba->io.soundcnt_h.volume_sounds];
-    sample_r = sample_r * sound_volume[gba->io.soundcnt_h.volume_sounds];
+    sample_l += (tone_2 * (bool)soundcnt_l.enable_sound_2_left);
+    sample_r += (tone_2 * (bool)soundcnt_l.enable_sound_2_right);
 
-    sample_l += (gba->apu.latch.fifo[FIFO_A] * (bool)gba->io.soundcnt_h.enable_fifo_a_left) * fifo_volume[gba->io.soundcnt_h.volume_fifo_a];
-    sample_r += (gba->apu.latch.fifo[FIFO_A] * (bool)gba->io.soundcnt_h.enable_fifo_a_right)  * fifo_volume[gba->io.soundcnt_h.volume_fifo_a];
+    sample_l += (wave * (bool)soundcnt_l.enable_sound_3_left);
+    sample_r += (wave * (bool)soundcnt_l.enable_sound_3_right);
 
-    sample_l += (gba->apu.latch.fifo[FIFO_B] * (bool)gba->io.soundcnt_h.enable_fifo_b_left) * fifo_volume[gba->io.soundcnt_h.volume_fifo_b];
-    sample_r += (gba->apu.latch.fifo[FIFO_B] * (bool)gba->io.soundcnt_h.enable_fifo_b_right) * fifo_volume[gba->io.soundcnt_h.volume_fifo_b];
+    sample_l += (noise * (bool)soundcnt_l.enable_sound_4_left);
+    sample_r += (noise * (bool)soundcnt_l.enable_sound_4_right);
 
-    sample_l += gba->io.soundbias.bias;
-    sample_r += gba->io.soundbias.bias;
+    // Master volume of the PSG channels, from 1/8 to 8/8
+    sample_l = sample_l * (soundcnt_l.sound_left_volume + 1) / 8;
+    sample_r = sample_r * (soundcnt_l.sound_right_volume + 1) / 8;
+
+    sample_l = sample_l * sound_volume[soundcnt_h.volume_sounds];
+    sample_r = sample_r * sound_volume[soundcnt_h.volume_sounds];
+
+    sample_l += (input->fifo[FIFO_A] * (bool)soundcnt_h.enable_fifo_a_left) * fifo_volume[soundcnt_h.volume_fifo_a];
+    sample_r += (input->fifo[FIFO_A] * (bool)soundcnt_h.enable_fifo_a_right)  * fifo_volume[soundcnt_h.volume_fifo_a];
+
+    sample_l += (input->fifo[FIFO_B] * (bool)soundcnt_h.enable_fifo_b_left) * fifo_volume[soundcnt_h.volume_fifo_b];
+    sample_r += (input->fifo[FIFO_B] * (bool)soundcnt_h.enable_fifo_b_right) * fifo_volume[soundcnt_h.volume_fifo_b];
+
+    sample_l += input->bias;
+    sample_r += input->bias;
 
     sample_l = max(min(sample_l, 0x3FF), 0) - 0x200;
     sample_r = max(min(sample_r, 0x3FF), 0) - 0x200;
@@ -216,7 +325,258 @@ apu_resample(
     sample_l *= 32; // Otherwise we can't hear much
     sample_r *= 32;
 
-    pthread_mutex_lock(&gba->apu.frontend_channels_mutex);
-    apu_rbuffer_push(&gba->apu.frontend_channels, (int16_t)sample_l, (int16_t)sample_r);
-    pthread_mutex_unlock(&gba->apu.frontend_channels_mutex);
+    return ((((uint32_t)(uint16_t)sample_l) << 16) | ((uint32_t)(uint16_t)sample_r));
+}
+
+/*
+** Hand to the band-limited synthesizer every change of the output of the tone, wave and noise
+** channels' generators happening before `until` (excluded).
+**
+** The generators of the channels that can't be heard are advanced in one go, unless the recorder
+** records each source separately.
+*/
+static
+void
+apu_mix_generators(
+    struct gba *gba,
+    uint64_t until
+) {
+    struct apu_mixer_input const *input;
+    struct apu_psg_generator *gens;
+    struct apu_wave_generator *wave;
+    uint16_t routing;
+    bool wave_audible;
+    size_t i;
+
+    input = &gba->apu.mixer.input;
+    gens = gba->apu.mixer.generators;
+    wave = &gba->apu.mixer.wave;
+    routing = gba->apu.recorder.record_sources ? 0xFFFF : input->soundcnt_l;
+    wave_audible = input->wave.period && (routing & 0x4400);
+
+    while (true) {
+        uint64_t edge;
+        size_t edge_idx;
+
+        edge = UINT64_MAX;
+        edge_idx = PSG_MAX;
+
+        for (i = 0; i < PSG_MAX; ++i) {
+            uint64_t next;
+            uint32_t bit;
+
+            bit = (i == PSG_NOISE) ? 3 : i;
+            if (!input->psg[i].volume || !(routing & (0x1100 << bit))) {
+                continue;
+            }
+
+            next = apu_psg_next_edge(&gens[i], i, &input->psg[i]);
+            if (next < edge) {
+                edge = next;
+                edge_idx = i;
+            }
+        }
+
+        if (edge >= until && (!wave_audible || wave->next >= until)) {
+            break;
+        }
+
+        if (wave_audible && wave->next <= edge) {
+            int16_t sample;
+
+            edge = wave->next;
+            sample = wave->sample;
+            apu_wave_step(wave, &input->wave);
+            if (wave->sample != sample) {
+                apu_blip_add_step(gba, edge, apu_mixer_frame(gba, input));
+            }
+        } else {
+            bool high;
+
+            high = gens[edge_idx].high;
+            apu_psg_advance(&gens[edge_idx], edge_idx, &input->psg[edge_idx], edge + 1);
+            if (gens[edge_idx].high != high) {
+                apu_blip_add_step(gba, edge, apu_mixer_frame(gba, input));
+            }
+        }
+    }
+
+    for (i = 0; i < PSG_MAX; ++i) {
+        apu_psg_advance(&gens[i], i, &input->psg[i], until);
+    }
+    apu_wave_advance(wave, &input->wave, until);
+}
+
+/*
+** Synthesize the output from `gba->apu.mixer.cursor` up to `until` (included) and push it in the
+** frontend's ring buffer, consuming the change log.
+**
+** Output samples are taken every `resample_step` cycles, the rate the real hardware the emulator
+** is running on (probably 48000Hz) expects them at.
+** Each change, and each step of the channels' generators, is handed to the band-limited synthesizer
+** at its exact timestamp. Steps happening at the same time than a change are run before it.
+*/
+static
+void
+apu_mix(
+    struct gba *gba,
+    uint64_t until
+) {
+    uint64_t period;
+    size_t i;
+
+    period = gba->apu.resample_period;
+
+    for (i = 0; i < gba->apu.mixer.log_len; ++i) {
+        struct apu_change const *change;
+
+        change = &gba->apu.mixer.log[i];
+        if (period) {
+            size_t j;
+
+            apu_mix_generators(gba, change->timestamp + 1);
+            for (j = 0; j < PSG_MAX; ++j) {
+                apu_psg_update_generator(
+                    &gba->apu.mixer.generators[j],
+                    j,
+                    &gba->apu.mixer.input.psg[j],
+                    &change->input.psg[j],
+                    change->timestamp
+                );
+            }
+            apu_wave_update_generator(&gba->apu.mixer.wave, &change->input.wave, change->timestamp);
+        }
+
+        gba->apu.mixer.input = change->input;
+
+        if (period) {
+            apu_blip_add_step(gba, change->timestamp, apu_mixer_frame(gba, &gba->apu.mixer.input));
+        }
+    }
+
+    if (period) {
+        apu_mix_generators(gba, until + 1);
+        apu_blip_emit(gba, until);
+    }
+
+    gba->apu.mixer.log_len = 0;
+    gba->apu.mixer.cursor = until + 1;
+}
+
+/*
+** Record in the change log the current inputs of the mixer, after they changed.
+*/
+void
+apu_log_change(
+    struct gba *gba
+) {
+    struct apu_mixer_input input;
+    struct apu_mixer_input const *last;
+
+    apu_wave_sync(gba);
+    apu_mixer_capture(gba, &input);
+
+    last = gba->apu.mixer.log_len ? &gba->apu.mixer.log[gba->apu.mixer.log_len - 1].input : &gba->apu.mixer.input;
+    if (!memcmp(last, &input, sizeof(input))) {
+        return ;
+    }
+
+    if (gba->apu.mixer.log_len == APU_CHANGE_LOG_CAPACITY) {
+        apu_mix(gba, gba->core.cycles);
+    }
+
+    gba->apu.mixer.log[gba->apu.mixer.log_len].timestamp = gba->core.cycles;
+    gba->apu.mixer.log[gba->apu.mixer.log_len].input = input;
+    ++gba->apu.mixer.log_len;
+}
+
+/*
+** Drop the change log and restart mixing from now with the current inputs.
+**
+** Used when the emulator's state is replaced, like when loading a quicksave.
+*/
+void
+apu_mixer_reset(
+    struct gba *gba
+) {
+    size_t i;
+
+    apu_wave_sync(gba);
+    apu_mixer_capture(gba, &gba->apu.mixer.input);
+    gba->apu.mixer.cursor = gba->core.cycles;
+    gba->apu.mixer.log_len = 0;
+
+    for (i = 0; i < PSG_MAX; ++i) {
+        apu_psg_reset_generator(&gba->apu.mixer.generators[i], i, &gba->apu.mixer.input.psg[i], gba->apu.mixer.cursor);
+    }
+    apu_wave_reset_generator(gba, &gba->apu.mixer.wave, &gba->apu.mixer.input.wave, gba->apu.mixer.cursor);
+
+    apu_blip_reset(gba, gba->apu.mixer.cursor, apu_mixer_frame(gba, &gba->apu.mixer.input));
+    apu_recorder_update_levels(gba);
+    apu_update_timer_fifos(gba);
+}
+
+/*
+** Synthesize the output up to now without waiting for the end of the frame.
+*/
+void
+apu_flush(
+    struct gba *gba
+) {
+    apu_mix(gba, gba->core.cycles);
+}
+
+/*
+** Dynamic rate control: slightly adjust the resampling rate so that the frontend's ring buffer stays
+** around `target_fill` frames, absorbing the drift between the emulator's and the audio device's clocks.
+**
+** The adjustment is proportional to the distance to the target and never exceeds `APU_RATE_CONTROL_MAX`
+** (in 1/1000th), which is inaudible.
+*/
+static
+void
+apu_update_rate(
+    struct gba *gba
+) {
+    int64_t max_adjust;
+    int64_t adjust;
+    int64_t fill;
+    int64_t target;
+
+    target = gba->apu.target_fill;
+    if (!target) {
+        return ;
+    }
+
+    /*
+    ** When the emulation is paced by the audio device, it blocks until the buffer drains down to the
+    ** target, so the buffer always looks about a frame too full while there's no drift to absorb.
+    */
+    if (gba->audio_master && gba->speed == 1) {
+        gba->apu.resample_step = gba->apu.resample_period;
+        return ;
+    }
+
+    fill = apu_rbuffer_fill(&gba->apu.frontend_channels);
+    max_adjust = (int64_t)gba->apu.resample_period * APU_RATE_CONTROL_MAX / 1000;
+
+    // A fuller buffer means we must produce less samples, hence a longer step.
+    adjust = max_adjust * (fill - target) / target;
+    adjust = max(min(adjust, max_adjust), -max_adjust);
+
+    gba->apu.resample_step = gba->apu.resample_period + adjust;
+}
+
+/*
+** Called once per frame to synthesize the output of the whole frame at once.
+*/
+static
+void
+apu_mix_frame(
+    struct gba *gba,
+    struct event_args args __unused
+) {
+    apu_mix(gba, gba->core.cycles);
+    apu_stretch_update(gba);
+    apu_update_rate(gba);
 }
@@ -0,0 +1,207 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2023 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Band-limited synthesis of the mixer's output.
+**
+** The mixer's output is a step function: it only changes when one of its inputs does. Instead of
+** point-sampling it, which aliases badly, each amplitude change is added to `deltas` as a band-limited
+** impulse, positioned at the change's exact cycle. The output samples are then the running sum
+** of `deltas`.
+**
+** The band-limited impulses are taken from a polyphase table of windowed sinc kernels,
+** one kernel per sub-sample phase, built once by `apu_blip_build_kernels()`.
+*/
+
+#include <string.h>
+#include <math.h>
+#include "gba/gba.h"
+#include "gba/apu.h"
+
+static int32_t apu_blip_kernels[APU_BLIP_PHASES][APU_BLIP_TAPS];
+
+/*
+** Build the polyphase table of windowed sinc kernels.
+**
+** The cutoff is a bit below the output's Nyquist frequency and the window is a Blackman one.
+** Each kernel is normalized so that its coefficients sum to exactly `1 << APU_BLIP_SHIFT`, so that
+** a step's amplitude is reproduced without any error once the kernel has been summed.
+*/
+void
+apu_blip_build_kernels(void)
+{
+    double const cutoff = 0.45;
+    size_t phase;
+    size_t i;
+
+    for (phase = 0; phase < APU_BLIP_PHASES; ++phase) {
+        double kernel[APU_BLIP_TAPS];
+        double sum;
+        int32_t total;
+
+        sum = 0.0;
+        for (i = 0; i < APU_BLIP_TAPS; ++i) {
+            double x;
+            double sinc;
+            double window;
+
+            /*
+            ** Distance between the tap and the step, which happens `phase / APU_BLIP_PHASES` samples
+            ** before the first tap, plus the kernel's delay.
+            */
+            x = (double)i + 1.0 - (double)phase / APU_BLIP_PHASES - APU_BLIP_TAPS / 2.0;
+
+            sinc = (x == 0.0) ? 1.0 : sin(M_PI * 2.0 * cutoff * x) / (M_PI * 2.0 * cutoff * x);
+            window = 0.42 + 0.5 * cos(M_PI * x / (APU_BLIP_TAPS / 2.0)) + 0.08 * cos(2.0 * M_PI * x / (APU_BLIP_TAPS / 2.0));
+            kernel[i] = sinc * max(window, 0.0);
+            sum += kernel[i];
+        }
+
+        total = 0;
+        for (i = 0; i < APU_BLIP_TAPS; ++i) {
+            apu_blip_kernels[phase][i] = (int32_t)lround(kernel[i] / sum * (1 << APU_BLIP_SHIFT));
+            total += apu_blip_kernels[phase][i];
+        }
+
+        // Put the rounding error in the kernel's center
+        apu_blip_kernels[phase][APU_BLIP_TAPS / 2] += (1 << APU_BLIP_SHIFT) - total;
+    }
+}
+
+/*
+** Reset the synthesizer so that its output is `frame`, with the next sample being due at `cycles`.
+*/
+void
+apu_blip_reset(
+    struct gba *gba,
+    uint64_t cycles,
+    uint32_t frame
+) {
+    struct apu_blip *blip;
+
+    blip = &gba->apu.blip;
+
+    memset(blip->deltas, 0, sizeof(blip->deltas));
+    blip->amplitude[0] = (int16_t)(frame >> 16);
+    blip->amplitude[1] = (int16_t)frame;
+    blip->integrator[0] = blip->amplitude[0] * (1 << APU_BLIP_SHIFT);
+    blip->integrator[1] = blip->amplitude[1] * (1 << APU_BLIP_SHIFT);
+    blip->next_time = cycles << APU_RESAMPLE_SHIFT;
+}
+
+/*
+** Output all the samples due up to `cycles` (included), which must all be final, to the time-stretcher
+** and the recorder.
+*/
+void
+apu_blip_emit(
+    struct gba *gba,
+    uint64_t cycles
+) {
+    struct apu_blip *blip;
+    uint64_t limit;
+    uint64_t step;
+    uint64_t count;
+
+    blip = &gba->apu.blip;
+    limit = cycles << APU_RESAMPLE_SHIFT;
+    step = gba->apu.resample_step;
+
+    if (blip->next_time > limit) {
+        return ;
+    }
+
+    count = (limit - blip->next_time) / step + 1;
+    blip->next_time += count * step;
+
+    while (count) {
+        uint32_t batch[APU_MIX_BATCH_SIZE];
+        int32_t integrator_l;
+        int32_t integrator_r;
+        size_t n;
+        size_t i;
+
+        n = min(count, APU_MIX_BATCH_SIZE);
+        count -= n;
+        integrator_l = blip->integrator[0];
+        integrator_r = blip->integrator[1];
+
+        for (i = 0; i < n; ++i) {
+            int32_t l;
+            int32_t r;
+
+            integrator_l += blip->deltas[0][i];
+            integrator_r += blip->deltas[1][i];
+            l = max(min(integrator_l >> APU_BLIP_SHIFT, INT16_MAX), INT16_MIN);
+            r = max(min(integrator_r >> APU_BLIP_SHIFT, INT16_MAX), INT16_MIN);
+            batch[i] = (((uint32_t)(uint16_t)l) << 16) | ((uint32_t)(uint16_t)r);
+        }
+
+        blip->integrator[0] = integrator_l;
+        blip->integrator[1] = integrator_r;
+
+        /* Shift the deltas that weren't consumed yet */
+        memmove(blip->deltas[0], blip->deltas[0] + n, (APU_BLIP_SIZE - n) * sizeof(int32_t));
+        memmove(blip->deltas[1], blip->deltas[1] + n, (APU_BLIP_SIZE - n) * sizeof(int32_t));
+        memset(blip->deltas[0] + APU_BLIP_SIZE - n, 0, n * sizeof(int32_t));
+        memset(blip->deltas[1] + APU_BLIP_SIZE - n, 0, n * sizeof(int32_t));
+
+        apu_stretch_push(gba, batch, n);
+        apu_recorder_push_frames(gba, batch, n);
+    }
+}
+
+/*
+** Change the output to `frame` at the given cycle.
+**
+** The change only affects the samples strictly after `cycles`, so all the previous ones are output first.
+*/
+void
+apu_blip_add_step(
+    struct gba *gba,
+    uint64_t cycles,
+    uint32_t frame
+) {
+    struct apu_blip *blip;
+    int32_t const *kernel;
+    uint64_t distance;
+    uint64_t step;
+    int32_t delta_l;
+    int32_t delta_r;
+    size_t i;
+
+    blip = &gba->apu.blip;
+    step = gba->apu.resample_step;
+
+    apu_blip_emit(gba, cycles);
+
+    // The sources' levels are recorded as they are once the change happened.
+    apu_recorder_update_levels(gba);
+
+    delta_l = (int16_t)(frame >> 16) - blip->amplitude[0];
+    delta_r = (int16_t)frame - blip->amplitude[1];
+
+    if (!delta_l && !delta_r) {
+        return ;
+    }
+
+    blip->amplitude[0] += delta_l;
+    blip->amplitude[1] += delta_r;
+
+    /*
+    ** The change happens `distance` before the next sample, which is at most one sample
+    ** unless the step was shortened since.
+    */
+    distance = min(blip->next_time - (cycles << APU_RESAMPLE_SHIFT), step);
+    kernel = apu_blip_kernels[min((step - distance) * APU_BLIP_PHASES / step, APU_BLIP_PHASES - 1)];
+    for (i = 0; i < APU_BLIP_TAPS; ++i) {
+        blip->deltas[0][i] += delta_l * kernel[i];
+        blip->deltas[1][i] += delta_r * kernel[i];
+    }
+}
@@ -0,0 +1,503 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2023 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** The tone (1 & 2) and noise (4) channels.
+**
+** The emulator only keeps track of what the CPU can observe (length counters, envelopes and the
+** sweep, all clocked by `apu_sequencer()`). The waveforms themselves are synthesized by the mixer,
+** which advances each channel's generator lazily from the time of its next step and its period
+** instead of scheduling an event for each step.
+*/
+
+#include <string.h>
+#include "gba/gba.h"
+#include "gba/apu.h"
+
+#define LFSR_15_LEN     0x7FFF
+#define LFSR_7_LEN      0x7F
+
+/*
+** The 4 duty cycles, one bit per step of the generator.
+*/
+static uint8_t const duty_lut[4] = { 0x80, 0x81, 0xE1, 0x7E };
+
+/*
+** The sequences of states of the 15 and 7 bits LFSRs and, for each state, its position in the
+** sequence, used to advance the noise channel by any amount of steps at once.
+*/
+static uint16_t lfsr_15_seq[LFSR_15_LEN];
+static uint16_t lfsr_15_idx[LFSR_15_LEN + 1];
+static uint8_t lfsr_7_seq[LFSR_7_LEN];
+static uint8_t lfsr_7_idx[LFSR_7_LEN + 1];
+
+static
+uint32_t
+apu_lfsr_step(
+    uint32_t lfsr,
+    bool narrow
+) {
+    bool carry;
+
+    carry = lfsr & 0b1;
+    lfsr >>= 1;
+    if (carry) {
+        lfsr ^= narrow ? 0x60 : 0x6000;
+    }
+    return (lfsr);
+}
+
+static
+uint32_t
+apu_lfsr_init(
+    bool narrow
+) {
+    return (narrow ? 0x40 : 0x4000);
+}
+
+void
+apu_psg_build_tables(void)
+{
+    uint32_t lfsr;
+    size_t i;
+
+    lfsr = apu_lfsr_init(false);
+    for (i = 0; i < LFSR_15_LEN; ++i) {
+        lfsr_15_seq[i] = lfsr;
+        lfsr_15_idx[lfsr] = i;
+        lfsr = apu_lfsr_step(lfsr, false);
+    }
+
+    lfsr = apu_lfsr_init(true);
+    for (i = 0; i < LFSR_7_LEN; ++i) {
+        lfsr_7_seq[i] = lfsr;
+        lfsr_7_idx[lfsr] = i;
+        lfsr = apu_lfsr_step(lfsr, true);
+    }
+}
+
+void
+apu_psg_init(
+    struct gba *gba
+) {
+    memset(gba->apu.psg, 0, sizeof(gba->apu.psg));
+    memset(&gba->apu.sweep, 0, sizeof(gba->apu.sweep));
+    gba->apu.sequencer_step = 0;
+}
+
+static
+void
+apu_psg_set_status(
+    struct gba *gba,
+    enum psg_idx idx,
+    bool status
+) {
+    uint32_t bit;
+
+    bit = (idx == PSG_NOISE) ? 3 : idx;
+    if (status) {
+        gba->io.soundcnt_x.bytes[0] |= (1u << bit);
+    } else {
+        gba->io.soundcnt_x.bytes[0] &= ~(1u << bit);
+    }
+}
+
+static
+void
+apu_psg_start(
+    struct gba *gba,
+    enum psg_idx idx,
+    bool use_length,
+    uint32_t length,
+    uint32_t envelope_volume,
+    bool envelope_increase,
+    uint32_t envelope_period
+) {
+    struct psg_channel *channel;
+
+    channel = &gba->apu.psg[idx];
+
+    channel->length = use_length ? 64 - length : 0;
+    channel->envelope.volume = envelope_volume;
+    channel->envelope.increase = envelope_increase;
+    channel->envelope.period = envelope_period;
+    channel->envelope.timer = envelope_period;
+    ++channel->trigger;
+
+    // The channel's DAC is off if the envelope can only output 0.
+    channel->enabled = envelope_volume || envelope_increase;
+    apu_psg_set_status(gba, idx, channel->enabled);
+}
+
+/*
+** Compute the sweep's next frequency.
+*/
+static
+uint32_t
+apu_sweep_next_frequency(
+    struct gba const *gba
+) {
+    uint32_t delta;
+
+    delta = gba->apu.sweep.frequency >> gba->io.sound1cnt_l.sweep_shift;
+    return (gba->io.sound1cnt_l.sweep_direction ? gba->apu.sweep.frequency - delta : gba->apu.sweep.frequency + delta);
+}
+
+void
+apu_tone_reset(
+    struct gba *gba,
+    enum psg_idx idx
+) {
+    struct io *io;
+
+    io = &gba->io;
+    io->tone_freq[idx].reset = false;
+
+    apu_psg_start(
+        gba,
+        idx,
+        io->tone_freq[idx].use_length,
+        io->tone_duty[idx].length,
+        io->tone_duty[idx].envelope_volume,
+        io->tone_duty[idx].envelope_direction,
+        io->tone_duty[idx].envelope_step_time
+    );
+
+    if (idx == PSG_TONE_1) {
+        struct sweep *sweep;
+
+        sweep = &gba->apu.sweep;
+        sweep->frequency = io->tone_freq[idx].frequency;
+        sweep->timer = io->sound1cnt_l.sweep_time ? io->sound1cnt_l.sweep_time : 8;
+        sweep->enabled = io->sound1cnt_l.sweep_time || io->sound1cnt_l.sweep_shift;
+
+        if (io->sound1cnt_l.sweep_shift && apu_sweep_next_frequency(gba) > 2047) {
+            apu_psg_stop(gba, idx);
+            return ;
+        }
+    }
+
+    apu_log_change(gba);
+}
+
+void
+apu_noise_reset(
+    struct gba *gba
+) {
+    struct io *io;
+
+    io = &gba->io;
+    io->sound4cnt_h.reset = false;
+
+    apu_psg_start(
+        gba,
+        PSG_NOISE,
+        io->sound4cnt_h.use_length,
+        io->sound4cnt_l.length,
+        io->sound4cnt_l.envelope_volume,
+        io->sound4cnt_l.envelope_direction,
+        io->sound4cnt_l.envelope_step_time
+    );
+
+    apu_log_change(gba);
+}
+
+void
+apu_psg_stop(
+    struct gba *gba,
+    enum psg_idx idx
+) {
+    gba->apu.psg[idx].enabled = false;
+    gba->apu.psg[idx].length = 0;
+    apu_psg_set_status(gba, idx, false);
+    apu_log_change(gba);
+}
+
+/*
+** Clock the length counters (256Hz).
+*/
+void
+apu_psg_length(
+    struct gba *gba
+) {
+    size_t idx;
+
+    for (idx = 0; idx < PSG_MAX; ++idx) {
+        struct psg_channel *channel;
+        bool use_length;
+
+        channel = &gba->apu.psg[idx];
+        use_length = (idx == PSG_NOISE) ? gba->io.sound4cnt_h.use_length : gba->io.tone_freq[idx].use_length;
+
+        if (channel->enabled && use_length && channel->length) {
+            --channel->length;
+            if (!channel->length) {
+                apu_psg_stop(gba, idx);
+            }
+        }
+    }
+}
+
+/*
+** Clock the frequency sweep of the first tone channel (128Hz).
+*/
+void
+apu_psg_sweep(
+    struct gba *gba
+) {
+    struct sweep *sweep;
+    struct io *io;
+    uint32_t frequency;
+
+    io = &gba->io;
+    sweep = &gba->apu.sweep;
+
+    if (!gba->apu.psg[PSG_TONE_1].enabled || !sweep->enabled || !sweep->timer) {
+        return ;
+    }
+
+    --sweep->timer;
+    if (sweep->timer) {
+        return ;
+    }
+
+    sweep->timer = io->sound1cnt_l.sweep_time ? io->sound1cnt_l.sweep_time : 8;
+    if (!io->sound1cnt_l.sweep_time) {
+        return ;
+    }
+
+    frequency = apu_sweep_next_frequency(gba);
+    if (frequency > 2047) {
+        apu_psg_stop(gba, PSG_TONE_1);
+        return ;
+    }
+
+    if (io->sound1cnt_l.sweep_shift) {
+        sweep->frequency = frequency;
+        io->tone_freq[0].frequency = frequency;
+        apu_log_change(gba);
+
+        // The overflow check is done a second time with the new frequency
+        if (apu_sweep_next_frequency(gba) > 2047) {
+            apu_psg_stop(gba, PSG_TONE_1);
+        }
+    }
+}
+
+/*
+** Clock the volume envelopes (64Hz).
+*/
+void
+apu_psg_envelope(
+    struct gba *gba
+) {
+    size_t idx;
+
+    for (idx = 0; idx < PSG_MAX; ++idx) {
+        struct psg_channel *channel;
+
+        channel = &gba->apu.psg[idx];
+
+        if (!channel->enabled || !channel->envelope.period) {
+            continue;
+        }
+
+        --channel->envelope.timer;
+        if (channel->envelope.timer) {
+            continue;
+        }
+
+        channel->envelope.timer = channel->envelope.period;
+
+        if (channel->envelope.increase && channel->envelope.volume < 15) {
+            ++channel->envelope.volume;
+            apu_log_change(gba);
+        } else if (!channel->envelope.increase && channel->envelope.volume > 0) {
+            --channel->envelope.volume;
+            apu_log_change(gba);
+        }
+    }
+}
+
+/*
+** Return the current parameters of the waveform generator of the given channel.
+*/
+void
+apu_psg_capture(
+    struct gba const *gba,
+    enum psg_idx idx,
+    struct apu_psg_input *input
+) {
+    struct psg_channel const *channel;
+
+    channel = &gba->apu.psg[idx];
+
+    memset(input, 0, sizeof(*input));
+    input->trigger = channel->trigger;
+
+    if (!channel->enabled) {
+        return ;
+    }
+
+    input->volume = channel->envelope.volume;
+
+    if (idx == PSG_NOISE) {
+        uint32_t ratio;
+        uint32_t shift;
+
+        ratio = gba->io.sound4cnt_h.ratio;
+        shift = gba->io.sound4cnt_h.shift;
+
+        // The LFSR isn't clocked at all with a shift of 14 or 15.
+        input->period = shift < 14 ? (ratio ? 32 * ratio : 16) << (shift + 1) : 0;
+        input->mode = gba->io.sound4cnt_h.width;
+    } else {
+        input->period = 16 * (2048 - gba->io.tone_freq[idx].frequency);
+        input->mode = gba->io.tone_duty[idx].duty;
+    }
+}
+
+/*
+** Restart the generator of the given channel at `cycles`.
+*/
+void
+apu_psg_reset_generator(
+    struct apu_psg_generator *gen,
+    enum psg_idx idx,
+    struct apu_psg_input const *input,
+    uint64_t cycles
+) {
+    gen->next = cycles + input->period;
+    gen->trigger = input->trigger;
+
+    if (idx == PSG_NOISE) {
+        gen->state = apu_lfsr_init(input->mode);
+        gen->high = false;
+    } else {
+        // The position in the duty cycle isn't reset when the channel is restarted.
+        gen->high = (duty_lut[input->mode] >> gen->state) & 0b1;
+    }
+}
+
+/*
+** Update the generator of the given channel after its parameters changed from `old` to `new` at `cycles`.
+**
+** A change of period only takes effect after the pending step, like the hardware which only reloads
+** its frequency timer when it expires.
+*/
+void
+apu_psg_update_generator(
+    struct apu_psg_generator *gen,
+    enum psg_idx idx,
+    struct apu_psg_input const *old,
+    struct apu_psg_input const *new,
+    uint64_t cycles
+) {
+    if (new->trigger != gen->trigger) {
+        apu_psg_reset_generator(gen, idx, new, cycles);
+        return ;
+    }
+
+    if (!old->period && new->period) {
+        gen->next = cycles + new->period;
+    }
+
+    if (old->mode != new->mode) {
+        if (idx == PSG_NOISE) {
+            // Keep what fits in the new width, avoiding the (invalid) null state.
+            gen->state &= new->mode ? LFSR_7_LEN : LFSR_15_LEN;
+            if (!gen->state) {
+                gen->state = apu_lfsr_init(new->mode);
+            }
+        } else {
+            gen->high = (duty_lut[new->mode] >> gen->state) & 0b1;
+        }
+    }
+}
+
+/*
+** Return the time of the next step of the generator that may change its output, or `UINT64_MAX` if
+** there is none.
+*/
+uint64_t
+apu_psg_next_edge(
+    struct apu_psg_generator const *gen,
+    enum psg_idx idx,
+    struct apu_psg_input const *input
+) {
+    uint32_t k;
+
+    if (!input->period) {
+        return (UINT64_MAX);
+    }
+
+    if (idx == PSG_NOISE) {
+        return (gen->next);
+    }
+
+    // Skip the steps where the duty cycle stays at the same level.
+    for (k = 0; k < 8; ++k) {
+        if (((duty_lut[input->mode] >> ((gen->state + k + 1) % 8)) & 0b1) != gen->high) {
+            return (gen->next + (uint64_t)k * input->period);
+        }
+    }
+
+    return (UINT64_MAX);
+}
+
+/*
+** Run at once all the steps of the generator that are due before `until` (excluded).
+*/
+void
+apu_psg_advance(
+    struct apu_psg_generator *gen,
+    enum psg_idx idx,
+    struct apu_psg_input const *input,
+    uint64_t until
+) {
+    uint64_t steps;
+
+    if (!input->period || gen->next >= until) {
+        return ;
+    }
+
+    steps = (until - 1 - gen->next) / input->period + 1;
+    gen->next += steps * input->period;
+
+    if (idx == PSG_NOISE) {
+        uint32_t state;
+
+        /*
+        ** Find the state before the last step in the LFSR's sequence: its least significant bit
+        ** is the new output.
+        */
+        if (input->mode) {
+            state = lfsr_7_seq[(lfsr_7_idx[gen->state] + (steps - 1) % LFSR_7_LEN) % LFSR_7_LEN];
+            gen->state = apu_lfsr_step(state, true);
+        } else {
+            state = lfsr_15_seq[(lfsr_15_idx[gen->state] + (steps - 1) % LFSR_15_LEN) % LFSR_15_LEN];
+            gen->state = apu_lfsr_step(state, false);
+        }
+        gen->high = state & 0b1;
+    } else {
+        gen->state = (gen->state + steps) % 8;
+        gen->high = (duty_lut[input->mode] >> gen->state) & 0b1;
+    }
+}
+
+/*
+** Return the current output of the generator, on the same scale than the wave channel's.
+*/
+int16_t
+apu_psg_output(
+    struct apu_psg_generator const *gen,
+    struct apu_psg_input const *input
+) {
+    return (gen->high ? 2 * input->volume : -2 * input->volume);
+}
@@ -0,0 +1,171 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2023 - The Hades Authors
+**
+\******************************************************************************/
+
+#include <string.h>
+#include <time.h>
+#include "gba/gba.h"
+#include "gba/apu.h"
+
+static_assert(!(APU_RBUFFER_CAPACITY & (APU_RBUFFER_CAPACITY - 1)));
+
+void
+apu_rbuffer_init(
+    struct apu_rbuffer *rbuffer
+) {
+    memset(rbuffer->data, 0, sizeof(rbuffer->data));
+    atomic_init(&rbuffer->write_idx, 0);
+    atomic_init(&rbuffer->read_idx, 0);
+    atomic_init(&rbuffer->overruns, 0);
+    atomic_init(&rbuffer->underruns, 0);
+    rbuffer->last_frame = 0;
+    atomic_init(&rbuffer->waiting, false);
+    pthread_mutex_init(&rbuffer->lock, NULL);
+    pthread_cond_init(&rbuffer->space, NULL);
+}
+
+/*
+** Push up to `count` frames in the ring buffer.
+**
+** Must only be called by the producer. Return the number of frames actually pushed, the
+** remaining ones being dropped and counted as overruns.
+*/
+size_t
+apu_rbuffer_push(
+    struct apu_rbuffer *rbuffer,
+    uint32_t const *frames,
+    size_t count
+) {
+    size_t write_idx;
+    size_t read_idx;
+    size_t start;
+    size_t first;
+    size_t n;
+
+    write_idx = atomic_load_explicit(&rbuffer->write_idx, memory_order_relaxed);
+    read_idx = atomic_load_explicit(&rbuffer->read_idx, memory_order_acquire);
+
+    n = min(count, APU_RBUFFER_CAPACITY - (write_idx - read_idx));
+    start = write_idx & (APU_RBUFFER_CAPACITY - 1);
+    first = min(n, APU_RBUFFER_CAPACITY - start);
+
+    memcpy(rbuffer->data + start, frames, first * sizeof(*frames));
+    memcpy(rbuffer->data, frames + first, (n - first) * sizeof(*frames));
+
+    atomic_store_explicit(&rbuffer->write_idx, write_idx + n, memory_order_release);
+
+    if (n < count) {
+        atomic_fetch_add_explicit(&rbuffer->overruns, count - n, memory_order_relaxed);
+    }
+
+    return (n);
+}
+
+/*
+** Pop `count` frames from the ring buffer.
+**
+** Must only be called by the consumer. If there isn't enough frames available, the missing ones are
+** replaced by the last frame popped (to avoid clicks) and counted as underruns.
+** Return the number of frames actually popped.
+*/
+size_t
+apu_rbuffer_pop(
+    struct apu_rbuffer *rbuffer,
+    uint32_t *frames,
+    size_t count
+) {
+    size_t write_idx;
+    size_t read_idx;
+    size_t start;
+    size_t first;
+    size_t n;
+    size_t i;
+
+    read_idx = atomic_load_explicit(&rbuffer->read_idx, memory_order_relaxed);
+    write_idx = atomic_load_explicit(&rbuffer->write_idx, memory_order_acquire);
+
+    n = min(count, write_idx - read_idx);
+    start = read_idx & (APU_RBUFFER_CAPACITY - 1);
+    first = min(n, APU_RBUFFER_CAPACITY - start);
+
+    memcpy(frames, rbuffer->data + start, first * sizeof(*frames));
+    memcpy(frames + first, rbuffer->data, (n - first) * sizeof(*frames));
+
+    atomic_store_explicit(&rbuffer->read_idx, read_idx + n, memory_order_release);
+
+    if (n) {
+        rbuffer->last_frame = frames[n - 1];
+    }
+
+    if (n < count) {
+        for (i = n; i < count; ++i) {
+            frames[i] = rbuffer->last_frame;
+        }
+        atomic_fetch_add_explicit(&rbuffer->underruns, count - n, memory_order_relaxed);
+    }
+
+    /* Wake up the producer if it's waiting for some room */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&rbuffer->waiting)) {
+        pthread_mutex_lock(&rbuffer->lock);
+        pthread_cond_signal(&rbuffer->space);
+        pthread_mutex_unlock(&rbuffer->lock);
+    }
+
+    return (n);
+}
+
+/*
+** Return the number of frames available in the ring buffer.
+**
+** Safe to call from either side, but the value is only a snapshot.
+*/
+size_t
+apu_rbuffer_fill(
+    struct apu_rbuffer *rbuffer
+) {
+    size_t write_idx;
+    size_t read_idx;
+
+    read_idx = atomic_load_explicit(&rbuffer->read_idx, memory_order_acquire);
+    write_idx = atomic_load_explicit(&rbuffer->write_idx, memory_order_acquire);
+    return (write_idx - read_idx);
+}
+
+/*
+** Block the producer until the ring buffer holds at most `fill` frames.
+**
+** The wait is bounded so the producer can't get stuck if the consumer stops.
+*/
+void
+apu_rbuffer_wait_space(
+    struct apu_rbuffer *rbuffer,
+    size_t fill
+) {
+    struct timespec deadline;
+
+    if (apu_rbuffer_fill(rbuffer) <= fill) {
+        return ;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += APU_RBUFFER_MAX_WAIT * 1000000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+
+    pthread_mutex_lock(&rbuffer->lock);
+    atomic_store(&rbuffer->waiting, true);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (apu_rbuffer_fill(rbuffer) > fill) {
+        if (pthread_cond_timedwait(&rbuffer->space, &rbuffer->lock, &deadline)) {
+            break;
+        }
+    }
+    atomic_store(&rbuffer->waiting, false);
+    pthread_mutex_unlock(&rbuffer->lock);
+}
@@ -0,0 +1,433 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2023 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** The audio recorder.
+**
+** The emulation thread pushes the samples it outputs in the recorder's ring buffers and never
+** waits on anything: if the writer thread can't keep up and a ring buffer is full, the new
+** samples are dropped and counted instead.
+** The writer thread periodically wakes up (or earlier, when a ring buffer is getting full) to write
+** to the disk the samples waiting in the ring buffers, and drains them one last time when the
+** recording is stopped.
+**
+** Two files can be recorded at the same time: the mix, as the APU outputs it, and, optionally,
+** each source of the GBA's audio in its own channel, before it is mixed.
+**
+** The mix is recorded before the time-stretcher, so a recording always plays at normal speed and
+** stays aligned with the sources' one, whatever the emulation speed was.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "hades.h"
+#include "compat.h"
+#include "gba/gba.h"
+#include "gba/apu.h"
+
+static_assert(!(APU_RECORDER_CAPACITY & (APU_RECORDER_CAPACITY - 1)));
+
+#define WAV_HEADER_SIZE     44
+
+static
+void
+apu_record_stream_init(
+    struct apu_record_stream *stream,
+    FILE *file,
+    uint32_t channels
+) {
+    stream->file = file;
+    stream->channels = channels;
+    stream->data_size = 0;
+    atomic_init(&stream->write_idx, 0);
+    atomic_init(&stream->read_idx, 0);
+}
+
+/*
+** Push `count` interleaved samples in the stream's ring buffer, or drop them all if there's
+** not enough space left.
+**
+** Must only be called by the emulation thread.
+*/
+static
+void
+apu_record_stream_push(
+    struct apu_recorder *recorder,
+    struct apu_record_stream *stream,
+    int16_t const *samples,
+    size_t count
+) {
+    size_t write_idx;
+    size_t read_idx;
+    size_t start;
+    size_t first;
+
+    write_idx = atomic_load_explicit(&stream->write_idx, memory_order_relaxed);
+    read_idx = atomic_load_explicit(&stream->read_idx, memory_order_acquire);
+
+    // Samples are dropped by whole batches to keep the channels aligned.
+    if (APU_RECORDER_CAPACITY - (write_idx - read_idx) < count) {
+        atomic_fetch_add_explicit(&recorder->dropped, count, memory_order_relaxed);
+        return ;
+    }
+
+    start = write_idx & (APU_RECORDER_CAPACITY - 1);
+    first = min(count, APU_RECORDER_CAPACITY - start);
+
+    memcpy(stream->data + start, samples, first * sizeof(*samples));
+    memcpy(stream->data, samples + first, (count - first) * sizeof(*samples));
+
+    atomic_store_explicit(&stream->write_idx, write_idx + count, memory_order_release);
+
+    // Wake up the writer thread early if the ring buffer just went over half full.
+    if (write_idx - read_idx < APU_RECORDER_CAPACITY / 2 && write_idx + count - read_idx >= APU_RECORDER_CAPACITY / 2) {
+        pthread_cond_signal(&recorder->wakeup);
+    }
+}
+
+/*
+** Write to the stream's file all the samples waiting in its ring buffer.
+**
+** Must only be called by the writer thread.
+*/
+static
+void
+apu_record_stream_flush(
+    struct apu_record_stream *stream
+) {
+    size_t write_idx;
+    size_t read_idx;
+    size_t start;
+    size_t first;
+    size_t n;
+
+    if (!stream->file) {
+        return ;
+    }
+
+    read_idx = atomic_load_explicit(&stream->read_idx, memory_order_relaxed);
+    write_idx = atomic_load_explicit(&stream->write_idx, memory_order_acquire);
+
+    n = write_idx - read_idx;
+    start = read_idx & (APU_RECORDER_CAPACITY - 1);
+    first = min(n, APU_RECORDER_CAPACITY - start);
+
+    fwrite(stream->data + start, sizeof(*stream->data), first, stream->file);
+    fwrite(stream->data, sizeof(*stream->data), n - first, stream->file);
+    stream->data_size += n * sizeof(*stream->data);
+
+    atomic_store_explicit(&stream->read_idx, write_idx, memory_order_release);
+}
+
+/*
+** Write the header of a WAV file describing `data_size` bytes of signed 16 bits PCM samples.
+*/
+static
+void
+apu_record_write_wav_header(
+    FILE *file,
+    uint32_t channels,
+    uint32_t sample_rate,
+    uint64_t data_size
+) {
+    uint8_t header[WAV_HEADER_SIZE];
+    uint32_t fields[][2] = {
+        // Offset, value
+        { 4,  (uint32_t)min(data_size + WAV_HEADER_SIZE - 8, UINT32_MAX) },
+        { 16, 16 },                             // Size of the "fmt " chunk
+        { 20, 1 | (channels << 16) },           // PCM, number of channels
+        { 24, sample_rate },
+        { 28, sample_rate * channels * 2 },     // Byte rate
+        { 32, (channels * 2) | (16 << 16) },    // Block align, bits per sample
+        { 40, (uint32_t)min(data_size, UINT32_MAX - WAV_HEADER_SIZE) },
+    };
+    size_t i;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header + 0, "RIFF", 4);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "fmt ", 4);
+    memcpy(header + 36, "data", 4);
+
+    // WAV files are always little-endian.
+    for (i = 0; i < array_length(fields); ++i) {
+        header[fields[i][0] + 0] = (uint8_t)(fields[i][1] >> 0);
+        header[fields[i][0] + 1] = (uint8_t)(fields[i][1] >> 8);
+        header[fields[i][0] + 2] = (uint8_t)(fields[i][1] >> 16);
+        header[fields[i][0] + 3] = (uint8_t)(fields[i][1] >> 24);
+    }
+
+    fwrite(header, sizeof(header), 1, file);
+}
+
+static
+void *
+apu_recorder_thread(
+    void *arg
+) {
+    struct apu_recorder *recorder;
+    bool stop;
+
+    recorder = arg;
+
+    do {
+        struct timespec deadline;
+
+        timespec_get(&deadline, TIME_UTC);
+        deadline.tv_nsec += APU_RECORDER_PERIOD * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_nsec -= 1000000000L;
+            ++deadline.tv_sec;
+        }
+
+        pthread_mutex_lock(&recorder->lock);
+        if (!recorder->stop) {
+            pthread_cond_timedwait(&recorder->wakeup, &recorder->lock, &deadline);
+        }
+        stop = recorder->stop;
+        pthread_mutex_unlock(&recorder->lock);
+
+        // Once stopped, the emulation thread doesn't push anything anymore so this last flush drains everything.
+        apu_record_stream_flush(&recorder->mix);
+        apu_record_stream_flush(&recorder->sources);
+    } while (!stop);
+
+    return (NULL);
+}
+
+/*
+** Open the given file and write the placeholder of its header, if any.
+*/
+static
+FILE *
+apu_recorder_open(
+    struct apu_recorder *recorder,
+    char const *path,
+    uint32_t channels
+) {
+    FILE *file;
+
+    file = hs_fopen(path, "wb");
+    if (!file) {
+        logln(HS_ERROR, "Failed to open %s%s%s: %s.", g_light_magenta, path, g_reset, strerror(errno));
+        return (NULL);
+    }
+
+    // The sizes are filled once the recording is stopped.
+    if (recorder->format == APU_RECORD_WAV) {
+        apu_record_write_wav_header(file, channels, recorder->sample_rate, 0);
+    }
+
+    return (file);
+}
+
+/*
+** Close the stream's file, finalizing its header if any.
+*/
+static
+void
+apu_recorder_close(
+    struct apu_recorder *recorder,
+    struct apu_record_stream *stream
+) {
+    if (!stream->file) {
+        return ;
+    }
+
+    if (recorder->format == APU_RECORD_WAV) {
+        fseek(stream->file, 0, SEEK_SET);
+        apu_record_write_wav_header(stream->file, stream->channels, recorder->sample_rate, stream->data_size);
+    }
+
+    fclose(stream->file);
+    stream->file = NULL;
+}
+
+/*
+** Start recording the audio output to `path` and, if `sources_path` isn't NULL, each source
+** separately to `sources_path`.
+**
+** Any recording in progress is stopped first.
+** Return false if the recording couldn't be started.
+*/
+bool
+apu_recorder_start(
+    struct gba *gba,
+    char const *path,
+    char const *sources_path,
+    enum apu_record_format format
+) {
+    struct apu_recorder *recorder;
+    FILE *sources_file;
+    FILE *mix_file;
+
+    recorder = &gba->apu.recorder;
+
+    apu_recorder_stop(gba);
+
+    if (!gba->apu.resample_period) {
+        logln(HS_ERROR, "Can't record the audio: the audio output is disabled.");
+        return (false);
+    }
+
+    recorder->format = format;
+    recorder->sample_rate = ((uint64_t)CYCLES_PER_SECOND << APU_RESAMPLE_SHIFT) / gba->apu.resample_period;
+
+    mix_file = apu_recorder_open(recorder, path, 2);
+    if (!mix_file) {
+        return (false);
+    }
+
+    sources_file = NULL;
+    if (sources_path) {
+        sources_file = apu_recorder_open(recorder, sources_path, APU_SOURCE_MAX);
+        if (!sources_file) {
+            fclose(mix_file);
+            return (false);
+        }
+    }
+
+    apu_record_stream_init(&recorder->mix, mix_file, 2);
+    apu_record_stream_init(&recorder->sources, sources_file, APU_SOURCE_MAX);
+    atomic_init(&recorder->dropped, 0);
+    recorder->record_sources = (sources_file != NULL);
+    recorder->stop = false;
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->wakeup, NULL);
+
+    if (pthread_create(&recorder->thread, NULL, apu_recorder_thread, recorder)) {
+        logln(HS_ERROR, "Failed to start the audio recorder's thread.");
+        apu_recorder_close(recorder, &recorder->mix);
+        apu_recorder_close(recorder, &recorder->sources);
+        pthread_mutex_destroy(&recorder->lock);
+        pthread_cond_destroy(&recorder->wakeup);
+        return (false);
+    }
+
+    recorder->active = true;
+    atomic_store_explicit(&recorder->recording, true, memory_order_relaxed);
+    apu_recorder_update_levels(gba);
+
+    logln(
+        HS_INFO,
+        "Recording the audio in %s%s%s.",
+        g_light_green,
+        path,
+        g_reset
+    );
+
+    return (true);
+}
+
+/*
+** Stop the recording in progress, if any, and finalize the recorded files.
+*/
+void
+apu_recorder_stop(
+    struct gba *gba
+) {
+    struct apu_recorder *recorder;
+    uint32_t dropped;
+
+    recorder = &gba->apu.recorder;
+
+    if (!recorder->active) {
+        return ;
+    }
+
+    // Output what's still pending in the change log.
+    apu_flush(gba);
+
+    recorder->active = false;
+    recorder->record_sources = false;
+    atomic_store_explicit(&recorder->recording, false, memory_order_relaxed);
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->stop = true;
+    pthread_cond_signal(&recorder->wakeup);
+    pthread_mutex_unlock(&recorder->lock);
+
+    pthread_join(recorder->thread, NULL);
+    pthread_mutex_destroy(&recorder->lock);
+    pthread_cond_destroy(&recorder->wakeup);
+
+    apu_recorder_close(recorder, &recorder->mix);
+    apu_recorder_close(recorder, &recorder->sources);
+
+    dropped = atomic_load_explicit(&recorder->dropped, memory_order_relaxed);
+    if (dropped) {
+        logln(HS_WARNING, "The audio recorder couldn't keep up and dropped %u samples.", dropped);
+    }
+}
+
+/*
+** Record `count` frames of the mix, as output by the APU before the time-stretcher, along with
+** `count` frames of the sources' current levels.
+*/
+void
+apu_recorder_push_frames(
+    struct gba *gba,
+    uint32_t const *frames,
+    size_t count
+) {
+    struct apu_recorder *recorder;
+    int16_t samples[APU_MIX_BATCH_SIZE * APU_SOURCE_MAX];
+    size_t i;
+
+    recorder = &gba->apu.recorder;
+
+    if (!recorder->active) {
+        return ;
+    }
+
+    hs_assert(count && count <= APU_MIX_BATCH_SIZE);
+
+    for (i = 0; i < count; ++i) {
+        samples[i * 2 + 0] = (int16_t)(frames[i] >> 16);
+        samples[i * 2 + 1] = (int16_t)frames[i];
+    }
+    apu_record_stream_push(recorder, &recorder->mix, samples, count * 2);
+
+    if (recorder->record_sources) {
+        for (i = 0; i < count; ++i) {
+            memcpy(samples + i * APU_SOURCE_MAX, recorder->levels, sizeof(recorder->levels));
+        }
+        apu_record_stream_push(recorder, &recorder->sources, samples, count * APU_SOURCE_MAX);
+    }
+}
+
+/*
+** Update the level of each source from the mixer's current state.
+**
+** The sources are recorded at full scale, regardless of their routing, of the master volumes
+** and of the bias.
+*/
+void
+apu_recorder_update_levels(
+    struct gba *gba
+) {
+    struct apu_mixer_input const *input;
+    struct apu_recorder *recorder;
+
+    recorder = &gba->apu.recorder;
+
+    if (!recorder->record_sources) {
+        return ;
+    }
+
+    input = &gba->apu.mixer.input;
+
+    recorder->levels[APU_SOURCE_TONE_1] = apu_psg_output(&gba->apu.mixer.generators[PSG_TONE_1], &input->psg[PSG_TONE_1]) * 512;
+    recorder->levels[APU_SOURCE_TONE_2] = apu_psg_output(&gba->apu.mixer.generators[PSG_TONE_2], &input->psg[PSG_TONE_2]) * 512;
+    recorder->levels[APU_SOURCE_WAVE] = gba->apu.mixer.wave.sample * 512;
+    recorder->levels[APU_SOURCE_NOISE] = apu_psg_output(&gba->apu.mixer.generators[PSG_NOISE], &input->psg[PSG_NOISE]) * 512;
+    recorder->levels[APU_SOURCE_FIFO_A] = input->fifo[FIFO_A] * 256;
+    recorder->levels[APU_SOURCE_FIFO_B] = input->fifo[FIFO_B] * 256;
+}
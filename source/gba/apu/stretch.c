@@ -0,0 +1,345 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2023 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** The time-stretcher.
+**
+** When the emulator runs faster than real time, it produces more samples than the audio device
+** can play. Instead of dropping them in chunks, or playing them faster (and higher), the
+** time-stretcher sits between the mixer and the frontend's ring buffer and shortens the output
+** to real time while preserving its pitch.
+**
+** It uses WSOLA (Waveform Similarity based Overlap-Add): the input is cut in sequences that are
+** cross-faded with each other, and the input frames between two sequences are skipped.
+** The start of each sequence is searched around its nominal position for the offset that
+** best matches the end of the previous one, so the cross-fades don't cause phase cancellations.
+**
+** The cost depends only on the number of output frames, so it's bounded whatever the speed.
+*/
+
+#include <string.h>
+#include <math.h>
+#include "hades.h"
+#include "compat.h"
+#include "gba/gba.h"
+#include "gba/apu.h"
+
+static_assert(APU_STRETCH_SEQUENCE >= 2 * APU_STRETCH_OVERLAP);
+
+/*
+** Return the mono downmix of the given frame, scaled down so the cross-correlation of
+** `APU_STRETCH_OVERLAP` frames fits in 32 bits.
+*/
+static inline
+int16_t
+apu_stretch_mono(
+    uint32_t frame
+) {
+    return (((int32_t)(int16_t)(frame >> 16) + (int32_t)(int16_t)frame) >> 6);
+}
+
+/*
+** Drop the frames waiting to be stretched and start again from scratch.
+*/
+static
+void
+apu_stretch_clear(
+    struct apu_stretch *stretch
+) {
+    stretch->input_len = 0;
+    stretch->skip = 0;
+    stretch->skip_frac = 0;
+    stretch->has_overlap = false;
+}
+
+/*
+** Reset the time-stretcher, keeping whether it's enabled or not.
+*/
+void
+apu_stretch_reset(
+    struct gba *gba
+) {
+    struct apu_stretch *stretch;
+
+    stretch = &gba->apu.stretch;
+    stretch->active = false;
+    stretch->ratio = 1ull << APU_STRETCH_SHIFT;
+    stretch->window_start = 0;
+    stretch->window_cycles = 0;
+    apu_stretch_clear(stretch);
+}
+
+/*
+** Measure the emulation speed and update the time-stretcher's ratio accordingly.
+**
+** Called once per frame.
+*/
+void
+apu_stretch_update(
+    struct gba *gba
+) {
+    struct apu_stretch *stretch;
+    uint64_t elapsed;
+    uint64_t speed;
+    uint64_t now;
+
+    stretch = &gba->apu.stretch;
+
+    // At normal speed the output is never stretched, even if the emulator is a bit late.
+    if (!stretch->enabled || gba->speed == 1) {
+        if (stretch->active) {
+            apu_stretch_reset(gba);
+        }
+        return ;
+    }
+
+    now = hs_tick_count_ns();
+    elapsed = now - stretch->window_start;
+    stretch->window_cycles += CYCLES_PER_FRAME;
+
+    // Restart the measurement if this is the first one or if the emulation was paused.
+    if (!stretch->window_start || elapsed > 5 * APU_STRETCH_WINDOW * 1000000ull) {
+        stretch->window_start = now;
+        stretch->window_cycles = 0;
+        return ;
+    }
+
+    if (elapsed < APU_STRETCH_WINDOW * 1000000ull) {
+        return ;
+    }
+
+    speed = (double)stretch->window_cycles / CYCLES_PER_SECOND * 1e9 / elapsed * (1 << APU_STRETCH_SHIFT);
+    stretch->window_start = now;
+    stretch->window_cycles = 0;
+
+    if (!stretch->active) {
+        // Only start stretching when clearly above real time, to avoid toggling back and forth.
+        if (speed >= (11ull << APU_STRETCH_SHIFT) / 10) {
+            apu_stretch_clear(stretch);
+            stretch->active = true;
+            stretch->ratio = speed;
+        }
+        return ;
+    }
+
+    stretch->ratio = (stretch->ratio * 3 + speed) / 4;
+
+    if (stretch->ratio < (21ull << APU_STRETCH_SHIFT) / 20) {
+        apu_stretch_reset(gba);
+    }
+}
+
+/*
+** Return the ratio to use for the next sequence, slightly adjusted to keep the frontend's ring
+** buffer around its target fill (see `apu_update_rate()`).
+*/
+static
+uint64_t
+apu_stretch_ratio(
+    struct gba *gba
+) {
+    int64_t max_adjust;
+    int64_t adjust;
+    int64_t ratio;
+    int64_t target;
+    int64_t fill;
+
+    ratio = gba->apu.stretch.ratio;
+    target = gba->apu.target_fill;
+    if (!target) {
+        return (ratio);
+    }
+
+    fill = apu_rbuffer_fill(&gba->apu.frontend_channels);
+    max_adjust = ratio * APU_STRETCH_CONTROL_MAX / 1000;
+
+    // A fuller buffer means we must skip more input.
+    adjust = max_adjust * (fill - target) / target;
+    adjust = max(min(adjust, max_adjust), -max_adjust);
+
+    return (ratio + adjust);
+}
+
+/*
+** Return the cross-correlation of `APU_STRETCH_OVERLAP` frames of `a` and `b`.
+**
+** Kept trivial so the compiler can vectorize it, this is where most of the time is spent.
+*/
+static inline
+int32_t
+apu_stretch_correlate(
+    int16_t const * restrict a,
+    int16_t const * restrict b
+) {
+    int32_t sum;
+    size_t i;
+
+    sum = 0;
+    for (i = 0; i < APU_STRETCH_OVERLAP; ++i) {
+        sum += (int32_t)a[i] * (int32_t)b[i];
+    }
+    return (sum);
+}
+
+/*
+** Return the offset, within `APU_STRETCH_SEEK` frames of the start of the input, where the next
+** sequence matches best the end of the previous one.
+*/
+static
+size_t
+apu_stretch_seek(
+    struct apu_stretch const *stretch
+) {
+    int16_t const *input;
+    double best_score;
+    int64_t energy;
+    size_t best;
+    size_t i;
+
+    input = stretch->input_mono;
+
+    energy = 0;
+    for (i = 0; i < APU_STRETCH_OVERLAP; ++i) {
+        energy += (int32_t)input[i] * (int32_t)input[i];
+    }
+
+    best = 0;
+    best_score = -INFINITY;
+    for (i = 0; i < APU_STRETCH_SEEK; ++i) {
+        double corr;
+        double score;
+
+        // Normalize by the energy of the candidate only, the one of the previous sequence doesn't change.
+        corr = apu_stretch_correlate(stretch->overlap_mono, input + i);
+        score = corr * fabs(corr) / (double)(energy + 1);
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+
+        energy += (int32_t)input[i + APU_STRETCH_OVERLAP] * (int32_t)input[i + APU_STRETCH_OVERLAP];
+        energy -= (int32_t)input[i] * (int32_t)input[i];
+    }
+
+    return (best);
+}
+
+/*
+** Output the next sequence and skip the input frames that shouldn't be heard.
+*/
+static
+void
+apu_stretch_process(
+    struct gba *gba
+) {
+    struct apu_stretch *stretch;
+    uint32_t output[APU_STRETCH_SEQUENCE - APU_STRETCH_OVERLAP];
+    uint32_t const *seq;
+    uint64_t skip;
+    size_t offset;
+    size_t i;
+
+    stretch = &gba->apu.stretch;
+    offset = 0;
+
+    if (stretch->has_overlap) {
+        offset = apu_stretch_seek(stretch);
+        seq = stretch->input + offset;
+
+        // Cross-fade the end of the previous sequence with the start of this one.
+        for (i = 0; i < APU_STRETCH_OVERLAP; ++i) {
+            int32_t l;
+            int32_t r;
+
+            l = (int16_t)(stretch->overlap[i] >> 16) * (int32_t)(APU_STRETCH_OVERLAP - i) + (int16_t)(seq[i] >> 16) * (int32_t)i;
+            r = (int16_t)stretch->overlap[i] * (int32_t)(APU_STRETCH_OVERLAP - i) + (int16_t)seq[i] * (int32_t)i;
+            l /= APU_STRETCH_OVERLAP;
+            r /= APU_STRETCH_OVERLAP;
+            output[i] = (((uint32_t)(uint16_t)l) << 16) | ((uint32_t)(uint16_t)r);
+        }
+    } else {
+        seq = stretch->input;
+        memcpy(output, seq, APU_STRETCH_OVERLAP * sizeof(*output));
+    }
+
+    memcpy(
+        output + APU_STRETCH_OVERLAP,
+        seq + APU_STRETCH_OVERLAP,
+        (APU_STRETCH_SEQUENCE - 2 * APU_STRETCH_OVERLAP) * sizeof(*output)
+    );
+
+    // Keep the end of the sequence to cross-fade it with the next one.
+    memcpy(stretch->overlap, seq + APU_STRETCH_SEQUENCE - APU_STRETCH_OVERLAP, sizeof(stretch->overlap));
+    memcpy(
+        stretch->overlap_mono,
+        stretch->input_mono + offset + APU_STRETCH_SEQUENCE - APU_STRETCH_OVERLAP,
+        sizeof(stretch->overlap_mono)
+    );
+    stretch->has_overlap = true;
+
+    apu_rbuffer_push(&gba->apu.frontend_channels, output, array_length(output));
+
+    // The next sequence nominally starts `ratio` times further in the input than in the output.
+    skip = apu_stretch_ratio(gba) * array_length(output) + stretch->skip_frac;
+    stretch->skip_frac = skip & ((1ull << APU_STRETCH_SHIFT) - 1);
+    skip >>= APU_STRETCH_SHIFT;
+
+    if (skip < stretch->input_len) {
+        stretch->input_len -= skip;
+        memmove(stretch->input, stretch->input + skip, stretch->input_len * sizeof(*stretch->input));
+        memmove(stretch->input_mono, stretch->input_mono + skip, stretch->input_len * sizeof(*stretch->input_mono));
+    } else {
+        stretch->skip = skip - stretch->input_len;
+        stretch->input_len = 0;
+    }
+}
+
+/*
+** Hand the given frames to the time-stretcher, which pushes them in the frontend's ring buffer
+** either as is or stretched, depending on the emulation speed.
+*/
+void
+apu_stretch_push(
+    struct gba *gba,
+    uint32_t const *frames,
+    size_t count
+) {
+    struct apu_stretch *stretch;
+
+    stretch = &gba->apu.stretch;
+
+    if (!stretch->active) {
+        apu_rbuffer_push(&gba->apu.frontend_channels, frames, count);
+        return ;
+    }
+
+    while (count) {
+        size_t n;
+        size_t i;
+
+        // Drop the frames skipped by the previous sequence.
+        n = min(count, stretch->skip);
+        frames += n;
+        count -= n;
+        stretch->skip -= n;
+
+        n = min(count, APU_STRETCH_INPUT_SIZE - stretch->input_len);
+        for (i = 0; i < n; ++i) {
+            stretch->input[stretch->input_len + i] = frames[i];
+            stretch->input_mono[stretch->input_len + i] = apu_stretch_mono(frames[i]);
+        }
+        stretch->input_len += n;
+        frames += n;
+        count -= n;
+
+        while (stretch->input_len >= APU_STRETCH_SEQUENCE + APU_STRETCH_SEEK) {
+            apu_stretch_process(gba);
+        }
+    }
+}
@@ -7,12 +7,18 @@
 **
 \******************************************************************************/
 
+/*
+** The wave channel.
+**
+** Like the tone and noise channels, the wave channel isn't driven by a scheduler event.
+** The emulator only computes the channel's position from the time it was started and its period
+** when it needs it (to know which bank of the wave RAM the CPU can access), and the mixer reads
+** the samples from its own copy of the wave RAM when synthesizing the output.
+*/
+
 #include <string.h>
 #include "gba/gba.h"
 #include "gba/apu.h"
-#include "gba/scheduler.h"
-
-static void apu_wave_step(struct gba *, struct event_args args);
 
 static int16_t volume_lut[4] = { 0, 4, 2, 1};
 
@@ -20,100 +26,232 @@ void
 apu_wave_init(
     struct gba *gba
 ) {
-    gba->apu.wave.step_handler = INVALID_EVENT_HANDLE;
-    gba->apu.wave.counter_handler = INVALID_EVENT_HANDLE;
+    memset(&gba->apu.wave, 0, sizeof(gba->apu.wave));
 }
 
 void
 apu_wave_reset(
     struct gba *gba
 ) {
-    size_t period;
+    struct wave *wave;
+
+    wave = &gba->apu.wave;
 
     gba->io.sound3cnt_x.reset = false;
     apu_wave_stop(gba);
 
     if (gba->io.sound3cnt_x.use_length) {
-        gba->apu.wave.length = 256 - gba->io.sound3cnt_h.length;
+        wave->length = 256 - gba->io.sound3cnt_h.length;
     } else {
-        gba->apu.wave.length = 0;
+        wave->length = 0;
     }
 
-    period = CYCLES_PER_SECOND / (2097152 / (2048 - gba->io.sound3cnt_x.sample_rate));
+    wave->enabled = true;
+    wave->start = gba->core.cycles; // TODO: Is there a delay before the sound is started?
+    wave->period = CYCLES_PER_SECOND / (2097152 / (2048 - gba->io.sound3cnt_x.sample_rate));
+    wave->steps = 0;
+    ++wave->trigger;
 
-    gba->apu.wave.step_handler = sched_add_event(
-        gba,
-        NEW_REPEAT_EVENT(
-            gba->core.cycles, // TODO: Is there a delay before the sound is started?
-            period,
-            apu_wave_step
-        )
-    );
+    gba->io.soundcnt_x.sound_3_status = true;
+    apu_log_change(gba);
 }
 
 void
 apu_wave_stop(
     struct gba *gba
 ) {
-    gba->apu.latch.wave = 0;
-    gba->apu.wave.step = 0;
+    apu_wave_sync(gba);
+    gba->apu.wave.enabled = false;
     gba->apu.wave.length = 0;
-    gba->io.soundcnt_x.sound_1_status = false;
+    gba->io.soundcnt_x.sound_3_status = false;
+    apu_log_change(gba);
+}
+
+/*
+** Return the number of steps the wave channel did since it was started.
+*/
+static
+uint64_t
+apu_wave_steps(
+    struct gba const *gba
+) {
+    struct wave const *wave;
+
+    wave = &gba->apu.wave;
 
-    if (gba->apu.wave.step_handler != INVALID_EVENT_HANDLE) {
-        sched_cancel_event(gba, gba->apu.wave.step_handler);
+    if (!wave->enabled || gba->core.cycles < wave->start) {
+        return (wave->steps);
     }
-    gba->apu.wave.step_handler = INVALID_EVENT_HANDLE;
 
-    if (gba->apu.wave.counter_handler != INVALID_EVENT_HANDLE) {
-        sched_cancel_event(gba, gba->apu.wave.counter_handler);
+    // The first step happens as soon as the channel is started.
+    return ((gba->core.cycles - wave->start) / wave->period + 1);
+}
+
+/*
+** Return the bank of the wave RAM currently being played, taking into account the swaps
+** that happened since the last call to `apu_wave_sync()` if `bank_mode` is 1.
+*/
+uint32_t
+apu_wave_bank(
+    struct gba const *gba
+) {
+    uint64_t steps;
+
+    steps = apu_wave_steps(gba);
+
+    if (gba->io.sound3cnt_l.bank_mode == 1 && ((steps / 32 - gba->apu.wave.steps / 32) & 0b1)) {
+        return (!gba->io.sound3cnt_l.bank_select);
     }
-    gba->apu.wave.counter_handler = INVALID_EVENT_HANDLE;
+    return (gba->io.sound3cnt_l.bank_select);
 }
 
 /*
-** Shift the wave bank and store the 4 least significant bits
-** into `gba->apu.latch.wave`.
+** Bring the wave channel's position up to date, updating `bank_select` accordingly.
+**
+** Must be called before writing to `REG_SOUND3CNT_L` or the wave RAM.
 */
-static
 void
-apu_wave_step(
-    struct gba *gba,
-    struct event_args args __unused
+apu_wave_sync(
+    struct gba *gba
 ) {
-    uint8_t byte;
-    int16_t sample;
+    gba->io.sound3cnt_l.bank_select = apu_wave_bank(gba);
+    gba->apu.wave.steps = apu_wave_steps(gba);
+}
 
-    if (!gba->io.sound3cnt_l.enable) {
-        apu_wave_stop(gba);
-        return ;
+/*
+** Return the current parameters of the wave channel.
+*/
+void
+apu_wave_capture(
+    struct gba const *gba,
+    struct apu_wave_input *input
+) {
+    memset(input, 0, sizeof(*input));
+
+    input->trigger = gba->apu.wave.trigger;
+    input->bank_mode = gba->io.sound3cnt_l.bank_mode;
+    input->bank_select = gba->io.sound3cnt_l.bank_select;
+    input->volume = gba->io.sound3cnt_h.force_volume ? 3 : volume_lut[gba->io.sound3cnt_h.volume];
+    memcpy(input->waveram, gba->io.waveram, sizeof(input->waveram));
+
+    if (gba->apu.wave.enabled) {
+        input->period = gba->apu.wave.period;
+    }
+}
+
+/*
+** Restart the mixer's generator of the wave channel at `cycles`.
+**
+** If the channel was already playing, its position is derived from when it was started.
+*/
+void
+apu_wave_reset_generator(
+    struct gba const *gba,
+    struct apu_wave_generator *gen,
+    struct apu_wave_input const *input,
+    uint64_t cycles
+) {
+    struct wave const *wave;
+    uint64_t steps;
+
+    wave = &gba->apu.wave;
+
+    gen->trigger = input->trigger;
+    gen->bank = input->bank_select;
+    gen->sample = 0;
+    gen->step = 0;
+    gen->next = cycles;
+
+    if (input->period && cycles > wave->start) {
+        steps = (cycles - wave->start - 1) / wave->period + 1;
+        gen->step = steps % 32;
+        gen->next = wave->start + steps * wave->period;
+    }
+}
+
+/*
+** Update the mixer's generator of the wave channel after its parameters changed at `cycles`.
+*/
+void
+apu_wave_update_generator(
+    struct apu_wave_generator *gen,
+    struct apu_wave_input const *input,
+    uint64_t cycles
+) {
+    if (input->trigger != gen->trigger) {
+        gen->trigger = input->trigger;
+        gen->step = 0;
+        gen->next = cycles;
     }
 
-    gba->io.soundcnt_x.sound_1_status = true;
+    if (!input->period) {
+        gen->sample = 0;
+    }
 
-    byte = gba->io.waveram[gba->io.sound3cnt_l.bank_select][gba->apu.wave.step / 2];
+    // The emulator keeps the bank in sync before each change, so this also covers writes to `REG_SOUND3CNT_L`.
+    gen->bank = input->bank_select;
+}
 
-    if (gba->apu.wave.step & 0b1) {
+/*
+** Run the next step of the generator: read the next sample of the wave RAM, apply the volume
+** and move to the next one.
+*/
+void
+apu_wave_step(
+    struct apu_wave_generator *gen,
+    struct apu_wave_input const *input
+) {
+    uint8_t byte;
+
+    byte = input->waveram[gen->bank][gen->step / 2];
+
+    if (gen->step & 0b1) {
         byte &= 0xF;
     } else {
         byte >>= 4;
     }
 
-    // Recenter the sample around 0.
-    sample = byte - 8;
-
-    // Apply volume
-    sample *= gba->io.sound3cnt_h.force_volume ? 3 : volume_lut[gba->io.sound3cnt_h.volume];
-
-    gba->apu.latch.wave = sample;
+    // Recenter the sample around 0 and apply the volume.
+    gen->sample = (byte - 8) * input->volume;
 
     // Swap bank if we reached the end of this one and `bank_mode` is 1.
-    ++gba->apu.wave.step;
-    if (gba->apu.wave.step == 32) {
-        gba->apu.wave.step = 0;
+    ++gen->step;
+    if (gen->step == 32) {
+        gen->step = 0;
 
-        if (gba->io.sound3cnt_l.bank_mode == 1) {
-            gba->io.sound3cnt_l.bank_select ^= 1;
+        if (input->bank_mode == 1) {
+            gen->bank ^= 1;
         }
     }
+
+    gen->next += input->period;
+}
+
+/*
+** Run at once all the steps of the generator that are due before `until` (excluded), when the
+** intermediate samples don't matter.
+*/
+void
+apu_wave_advance(
+    struct apu_wave_generator *gen,
+    struct apu_wave_input const *input,
+    uint64_t until
+) {
+    uint64_t steps;
+
+    if (!input->period || gen->next >= until) {
+        return ;
+    }
+
+    steps = (until - 1 - gen->next) / input->period;
+
+    if (input->bank_mode == 1 && (((gen->step + steps) / 32) & 0b1)) {
+        gen->bank ^= 1;
+    }
+
+    gen->step = (gen->step + steps) % 32;
+    gen->next += steps * input->period;
+
+    // The last step is run normally to get the last sample.
+    apu_wave_step(gen, input);
 }
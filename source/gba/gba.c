@@ -22,14 +22,80 @@ void
 gba_init(
     struct gba *gba
 ) {
+    size_t i;
+
     memset(gba, 0, sizeof(*gba));
 
     /* Initialize the ARM decoder */
     core_arm_decode_insns();
     core_thumb_decode_insns();
 
+    /* Initialize the color conversion tables */
+    ppu_build_color_luts();
+
+    /* Initialize the message queue */
+    for (i = 0; i < GBA_MESSAGE_QUEUE_CAPACITY; ++i) {
+        atomic_init(&gba->message_queue.slots[i].sequence, i);
+    }
+    atomic_init(&gba->message_queue.write_idx, 0);
+    atomic_init(&gba->message_queue.waiting, false);
     pthread_mutex_init(&gba->message_queue.lock, NULL);
     pthread_cond_init(&gba->message_queue.ready, NULL);
+
+    /* Initialize the audio synthesizer's kernels and the noise channel's tables */
+    apu_blip_build_kernels();
+    apu_psg_build_tables();
+
+    /* Initialize the audio ring buffer, shared with the frontend */
+    apu_rbuffer_init(&gba->apu.frontend_channels);
+    atomic_init(&gba->apu.recorder.recording, false);
+
+    /* Initialize the framebuffers */
+    gba->framebuffer_back = 0;
+    gba->framebuffer_front = 1;
+    atomic_init(&gba->framebuffer_ready, 2);
+}
+
+/*
+** Return the latest frame completed by the emulator.
+**
+** `seq`, if not NULL, is set to the sequence number of that frame, which can be used to tell whether
+** it changed since the previous call.
+**
+** The returned buffer is owned by the frontend until the next call to this function, which
+** must always be made from the same thread.
+*/
+uint32_t const *
+gba_framebuffer_acquire(
+    struct gba *gba,
+    uint32_t *seq
+) {
+    uint32_t ready;
+
+    ready = atomic_load_explicit(&gba->framebuffer_ready, memory_order_acquire);
+
+    while ((ready >> 2) != gba->framebuffer_front_seq) {
+        if (atomic_compare_exchange_weak_explicit(
+            &gba->framebuffer_ready,
+            &ready,
+            (ready & ~0b11u) | gba->framebuffer_front,
+            memory_order_acq_rel,
+            memory_order_acquire
+        )) {
+            gba->framebuffer_front = ready & 0b11;
+            gba->framebuffer_front_seq = ready >> 2;
+
+            // Let the frame skip policy know the frontend is ready for another frame.
+            atomic_store_explicit(&gba->frame_requested, true, memory_order_relaxed);
+            break;
+        }
+    }
+
+    if (seq) {
+        *seq = gba->framebuffer_front_seq;
+    }
+
+    return (gba->framebuffers[gba->framebuffer_front]);
 }
 
 /*
@@ -43,6 +109,7 @@ gba_reset(
     gba->started = false;
     gba->state = GBA_STATE_PAUSE;
 
+    ppu_render_sync(gba);
     sched_cleanup(gba);
 
     sched_init(gba);
@@ -78,6 +145,134 @@ gba_skip_bios(
     core_reload_pipeline(gba);
 }
 
+/*
+** Restart the frame pacing from now, after a pause or any other discontinuity.
+*/
+static
+void
+gba_pacer_reset(
+    struct frame_pacer *pacer
+) {
+    pacer->deadline = hs_tick_count_ns();
+}
+
+/*
+** Wait until the deadline of the frame that was just emulated.
+**
+** Deadlines are absolute, each one being exactly `time_per_frame` after the previous one, so that
+** neither the sleep's inaccuracy nor the emulation's time accumulate into a drift.
+**
+** We sleep until a bit before the deadline and spin for the remaining time. The spin's duration
+** follows how much the OS oversleeps.
+*/
+static
+void
+gba_pacer_wait(
+    struct gba *gba,
+    struct frame_pacer *pacer
+) {
+    uint64_t error;
+    uint64_t now;
+
+    pacer->deadline += pacer->time_per_frame;
+    now = hs_tick_count_ns();
+
+    /* Don't try to catch up if we are way too late, that would only make things worse. */
+    if (now > pacer->deadline + FRAME_PACER_MAX_LATE * pacer->time_per_frame) {
+        pacer->deadline = now;
+        return ;
+    }
+
+    if (now < pacer->deadline) {
+        if (pacer->deadline - now > pacer->spin) {
+            uint64_t target;
+
+            target = pacer->deadline - pacer->spin;
+            hs_sleep_until_ns(target);
+            now = hs_tick_count_ns();
+
+            pacer->oversleep = (pacer->oversleep * 7 + (now > target ? now - target : 0)) / 8;
+            pacer->spin = min(pacer->oversleep + pacer->oversleep / 2 + FRAME_PACER_MIN_SPIN, FRAME_PACER_MAX_SPIN);
+        }
+
+        while (now < pacer->deadline) {
+            hs_pause();
+            now = hs_tick_count_ns();
+        }
+    }
+
+    /* Measure how far from the deadline we actually are and publish it periodically */
+    error = now - pacer->deadline;
+    pacer->error_sum += error;
+    pacer->error_max = max(pacer->error_max, error);
+    ++pacer->error_count;
+
+    if (pacer->error_count == FRAME_PACER_REPORT_FRAMES) {
+        atomic_store_explicit(&gba->pacing_error.avg, pacer->error_sum / pacer->error_count / 1000, memory_order_relaxed);
+        atomic_store_explicit(&gba->pacing_error.max, pacer->error_max / 1000, memory_order_relaxed);
+        pacer->error_sum = 0;
+        pacer->error_max = 0;
+        pacer->error_count = 0;
+    }
+}
+
+/*
+** Pop the oldest message of the message queue into `message`.
+**
+** Must only be called by the emulation thread. Return false if the queue is empty.
+*/
+static
+bool
+gba_message_pop(
+    struct gba *gba,
+    union message_any *message
+) {
+    struct message_queue *mqueue;
+    struct message_slot *slot;
+
+    mqueue = &gba->message_queue;
+    slot = &mqueue->slots[mqueue->read_idx & (GBA_MESSAGE_QUEUE_CAPACITY - 1)];
+
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != mqueue->read_idx + 1) {
+        return (false);
+    }
+
+    memcpy(message, &slot->message, slot->message.super.size);
+
+    // Release the slot for the producers.
+    atomic_store_explicit(&slot->sequence, mqueue->read_idx + GBA_MESSAGE_QUEUE_CAPACITY, memory_order_release);
+    ++mqueue->read_idx;
+    return (true);
+}
+
+/*
+** Sleep until a new message is pushed in the message queue.
+*/
+static
+void
+gba_message_wait(
+    struct gba *gba
+) {
+    struct message_queue *mqueue;
+    struct message_slot *slot;
+
+    mqueue = &gba->message_queue;
+    slot = &mqueue->slots[mqueue->read_idx & (GBA_MESSAGE_QUEUE_CAPACITY - 1)];
+
+    pthread_mutex_lock(&mqueue->lock);
+    atomic_store_explicit(&mqueue->waiting, true, memory_order_relaxed);
+
+    // Pairs with the fence in `gba_message_push()`: either we see the message or the producer sees `waiting`.
+    atomic_thread_fence(memory_order_seq_cst);
+
+    while (atomic_load_explicit(&slot->sequence, memory_order_acquire) != mqueue->read_idx + 1) {
+        pthread_cond_wait(&mqueue->ready, &mqueue->lock);
+    }
+
+    atomic_store_explicit(&mqueue->waiting, false, memory_order_relaxed);
+    pthread_mutex_unlock(&mqueue->lock);
+}
+
 /*
 ** Run the emulator, consuming messages that dictate what the emulator should do.
 **
@@ -93,25 +288,23 @@ void
 gba_main_loop(
     struct gba *gba
 ) {
-    uint64_t last_measured_time;
-    uint64_t accumulated_time;
-    uint64_t time_per_frame;
+    struct frame_pacer pacer;
+
+    memset(&pacer, 0, sizeof(pacer));
+    pacer.spin = FRAME_PACER_MAX_SPIN;
+    pacer.oversleep = FRAME_PACER_MAX_SPIN / 2;
+    gba_pacer_reset(&pacer);
 
-    last_measured_time = hs_tick_count();
-    accumulated_time = 0;
-    time_per_frame = 0;
     while (true) {
-        struct message_queue *mqueue;
+        union message_any any;
         struct message *message;
 
-        pthread_mutex_lock(&gba->message_queue.lock);
-
-        mqueue = &gba->message_queue;
-        message = mqueue->messages;
-        while (mqueue->length) {
+        message = &any.super;
+        while (gba_message_pop(gba, &any)) {
             switch (message->type) {
                 case MESSAGE_EXIT: {
-                    pthread_mutex_unlock(&gba->message_queue.lock);
+                    apu_recorder_stop(gba);
+                    ppu_set_threaded_rendering(gba, false);
                     return ;
                 };
                 case MESSAGE_BIOS: {
@@ -177,8 +370,7 @@ gba_main_loop(
                     message_reset = (struct message_reset *)message;
 
                     gba_reset(gba);
-                    last_measured_time = hs_tick_count();
-                    accumulated_time = 0;
+                    gba_pacer_reset(&pacer);
 
                     if (message_reset->skip_bios) {
                         gba_skip_bios(gba);
@@ -191,10 +383,10 @@ gba_main_loop(
                     message_run = (struct message_speed *)message;
                     gba->speed = message_run->speed;
                     if (message_run->speed) {
-                        time_per_frame = 1.f / 59.737f * 1000.f * 1000.f / (float)gba->speed;
-                        accumulated_time = 0;
+                        pacer.time_per_frame = 1.0 / 59.737 * 1000.0 * 1000.0 * 1000.0 / (double)gba->speed;
+                        gba_pacer_reset(&pacer);
                     } else {
-                        time_per_frame = 0.f;
+                        pacer.time_per_frame = 0;
                     }
                     break;
                 };
@@ -255,16 +447,75 @@ gba_main_loop(
                     struct message_audio_freq *message_audio_freq;
 
                     message_audio_freq = (struct message_audio_freq *)message;
-                    gba->apu.resample_frequency = message_audio_freq->resample_frequency;
+
+                    // The recorded files can't change their sample rate midway.
+                    apu_recorder_stop(gba);
+
+                    gba->apu.resample_period = ((uint64_t)CYCLES_PER_SECOND << APU_RESAMPLE_SHIFT) / message_audio_freq->sample_rate;
+                    gba->apu.resample_step = gba->apu.resample_period;
+
+                    // Keep enough frames in the ring buffer for the device to pull two buffers.
+                    gba->apu.target_fill = min(message_audio_freq->buffer_size * 2, APU_RBUFFER_CAPACITY / 2);
+                    apu_mixer_reset(gba);
+                    break;
+                };
+                case MESSAGE_AUDIO_RECORD_START: {
+                    struct message_audio_record *message_audio_record;
+
+                    message_audio_record = (struct message_audio_record *)message;
+                    apu_recorder_start(
+                        gba,
+                        message_audio_record->path,
+                        message_audio_record->sources_path,
+                        message_audio_record->format
+                    );
+                    free(message_audio_record->path);
+                    free(message_audio_record->sources_path);
+                    break;
+                };
+                case MESSAGE_AUDIO_RECORD_STOP: {
+                    apu_recorder_stop(gba);
                     break;
                 };
                 case MESSAGE_SETTINGS_COLOR_CORRECTION: {
                     struct message_color_correction *message_color_correction;
 
                     message_color_correction = (struct message_color_correction *)message;
+
+                    // The render thread may be drawing a scanline with the current setting.
+                    ppu_render_sync(gba);
                     gba->color_correction = message_color_correction->color_correction;
                     break;
                 };
+                case MESSAGE_SETTINGS_THREADED_RENDERING: {
+                    struct message_threaded_rendering *message_threaded_rendering;
+
+                    message_threaded_rendering = (struct message_threaded_rendering *)message;
+                    ppu_set_threaded_rendering(gba, message_threaded_rendering->threaded_rendering);
+                    break;
+                };
+                case MESSAGE_SETTINGS_AUDIO_MASTER: {
+                    struct message_audio_master *message_audio_master;
+
+                    message_audio_master = (struct message_audio_master *)message;
+                    gba->audio_master = message_audio_master->audio_master;
+                    break;
+                };
+                case MESSAGE_SETTINGS_TIME_STRETCH: {
+                    struct message_time_stretch *message_time_stretch;
+
+                    message_time_stretch = (struct message_time_stretch *)message;
+                    gba->apu.stretch.enabled = message_time_stretch->time_stretch;
+                    apu_stretch_reset(gba);
+                    break;
+                };
+                case MESSAGE_SETTINGS_FRAME_SKIP: {
+                    struct message_frame_skip *message_frame_skip;
+
+                    message_frame_skip = (struct message_frame_skip *)message;
+                    gba->frame_skip = message_frame_skip->frame_skip;
+                    break;
+                };
                 case MESSAGE_SETTINGS_RTC: {
                     struct message_device_state *message_device_state;
 
@@ -349,27 +600,14 @@ gba_main_loop(
 #endif
                 default: unimplemented(HS_CORE, "GBA message type with ID %i unimplemented.", message->type);
             }
-            mqueue->allocated_size -= message->size;
-            --mqueue->length;
-            message = (struct message *)((uint8_t *)message + message->size);
         }
-        free(mqueue->messages);
-        mqueue->messages = NULL;
-
-        /*
-        ** Wait until there's new messages in the message queue.
-        **
-        ** We must do this here and not in the switch/case below because `gba->message_queue.lock`
-        ** must be locked when calling `pthread_cond_wait()`.
-        */
+
+        // Wait until there's new messages in the message queue.
         if (gba->state == GBA_STATE_PAUSE) {
-            pthread_cond_wait(&gba->message_queue.ready, &gba->message_queue.lock);
-            last_measured_time = hs_tick_count();
-            accumulated_time = 0;
+            gba_message_wait(gba);
+            gba_pacer_reset(&pacer);
         }
 
-        pthread_mutex_unlock(&gba->message_queue.lock);
-
         switch (gba->state) {
             case GBA_STATE_PAUSE: break;
             case GBA_STATE_RUN: {
@@ -451,29 +689,24 @@ gba_main_loop(
         }
 
         /* Limit FPS */
-        if (gba->speed) {
-            uint64_t now;
-
-            now = hs_tick_count();
-            accumulated_time += now - last_measured_time;
-            last_measured_time = now;
-
-            if (accumulated_time < time_per_frame) {
-                hs_usleep(time_per_frame - accumulated_time);
-                now = hs_tick_count();
-                accumulated_time += now - last_measured_time;
-                last_measured_time = now;
-            }
-            accumulated_time -= time_per_frame;
+        if (gba->audio_master && gba->speed == 1 && gba->apu.target_fill) {
+            apu_rbuffer_wait_space(&gba->apu.frontend_channels, gba->apu.target_fill);
+            gba_pacer_reset(&pacer);
+        } else if (gba->speed) {
+            gba_pacer_wait(gba, &pacer);
         } else {
-            last_measured_time = hs_tick_count();
-            accumulated_time = 0;
+            gba_pacer_reset(&pacer);
         }
     }
 }
 
 /*
 ** Put the given message in the message queue.
+**
+** Can be called by any number of threads at the same time without taking any lock: each producer
+** reserves a slot by incrementing `write_idx` and publishes the message by updating the slot's
+** sequence number (see Dmitry Vyukov's bounded MPMC queue).
+** If the queue is full, the caller waits for the emulation thread to consume some messages.
 */
 static
 void
@@ -481,23 +714,52 @@ gba_message_push(
     struct gba *gba,
     struct message *message
 ) {
-    size_t new_size;
     struct message_queue *mqueue;
+    struct message_slot *slot;
+    size_t write_idx;
 
-    mqueue = &gba->message_queue;
-    pthread_mutex_lock(&gba->message_queue.lock);
+    hs_assert(message->size <= sizeof(union message_any));
 
-    new_size = mqueue->allocated_size + message->size;
+    mqueue = &gba->message_queue;
+    write_idx = atomic_load_explicit(&mqueue->write_idx, memory_order_relaxed);
 
-    mqueue->messages = realloc(mqueue->messages, new_size);
-    hs_assert(mqueue->messages);
-    memcpy((uint8_t *)mqueue->messages + mqueue->allocated_size, message, message->size);
+    while (true) {
+        intptr_t diff;
+
+        slot = &mqueue->slots[write_idx & (GBA_MESSAGE_QUEUE_CAPACITY - 1)];
+        diff = (intptr_t)atomic_load_explicit(&slot->sequence, memory_order_acquire) - (intptr_t)write_idx;
+
+        if (diff == 0) {
+            // The slot is free, try to reserve it. On failure, `write_idx` is reloaded.
+            if (atomic_compare_exchange_weak_explicit(
+                &mqueue->write_idx,
+                &write_idx,
+                write_idx + 1,
+                memory_order_relaxed,
+                memory_order_relaxed
+            )) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The queue is full.
+            hs_usleep(100);
+            write_idx = atomic_load_explicit(&mqueue->write_idx, memory_order_relaxed);
+        } else {
+            // Another producer reserved this slot first.
+            write_idx = atomic_load_explicit(&mqueue->write_idx, memory_order_relaxed);
+        }
+    }
 
-    mqueue->length += 1;
-    mqueue->allocated_size = new_size;
+    memcpy(&slot->message, message, message->size);
+    atomic_store_explicit(&slot->sequence, write_idx + 1, memory_order_release);
 
-    pthread_cond_broadcast(&gba->message_queue.ready);
-    pthread_mutex_unlock(&gba->message_queue.lock);
+    // Only wake up the emulation thread if it's waiting for a message.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&mqueue->waiting, memory_order_relaxed)) {
+        pthread_mutex_lock(&mqueue->lock);
+        pthread_cond_signal(&mqueue->ready);
+        pthread_mutex_unlock(&mqueue->lock);
+    }
 }
 
 void
@@ -712,7 +974,8 @@ gba_send_quicksave(
 void
 gba_send_audio_resample_freq(
     struct gba *gba,
-    uint64_t resample_freq
+    uint32_t sample_rate,
+    uint32_t buffer_size
 ) {
     gba_message_push(
         gba,
@@ -721,7 +984,42 @@ gba_send_audio_resample_freq(
                 .type = MESSAGE_AUDIO_RESAMPLE_FREQ,
                 .size = sizeof(struct message_audio_freq),
             },
-            .resample_frequency = resample_freq,
+            .sample_rate = sample_rate,
+            .buffer_size = buffer_size,
+        })
+    );
+}
+
+void
+gba_send_audio_record_start(
+    struct gba *gba,
+    char const *path,
+    char const *sources_path,
+    enum apu_record_format format
+) {
+    gba_message_push(
+        gba,
+        (struct message *)&((struct message_audio_record) {
+            .super = (struct message){
+                .type = MESSAGE_AUDIO_RECORD_START,
+                .size = sizeof(struct message_audio_record),
+            },
+            .path = strdup(path),
+            .sources_path = sources_path ? strdup(sources_path) : NULL,
+            .format = format,
+        })
+    );
+}
+
+void
+gba_send_audio_record_stop(
+    struct gba *gba
+) {
+    gba_message_push(
+        gba,
+        &((struct message) {
+            .type = MESSAGE_AUDIO_RECORD_STOP,
+            .size = sizeof(struct message),
         })
     );
 }
@@ -743,6 +1041,74 @@ gba_send_settings_color_correction(
     );
 }
 
+void
+gba_send_settings_threaded_rendering(
+    struct gba *gba,
+    bool threaded_rendering
+) {
+    gba_message_push(
+        gba,
+        (struct message *)&((struct message_threaded_rendering) {
+            .super = (struct message){
+                .type = MESSAGE_SETTINGS_THREADED_RENDERING,
+                .size = sizeof(struct message_threaded_rendering),
+            },
+            .threaded_rendering = threaded_rendering,
+        })
+    );
+}
+
+void
+gba_send_settings_frame_skip(
+    struct gba *gba,
+    int32_t frame_skip
+) {
+    gba_message_push(
+        gba,
+        (struct message *)&((struct message_frame_skip) {
+            .super = (struct message){
+                .type = MESSAGE_SETTINGS_FRAME_SKIP,
+                .size = sizeof(struct message_frame_skip),
+            },
+            .frame_skip = frame_skip,
+        })
+    );
+}
+
+void
+gba_send_settings_audio_master(
+    struct gba *gba,
+    bool audio_master
+) {
+    gba_message_push(
+        gba,
+        (struct message *)&((struct message_audio_master) {
+            .super = (struct message){
+                .type = MESSAGE_SETTINGS_AUDIO_MASTER,
+                .size = sizeof(struct message_audio_master),
+            },
+            .audio_master = audio_master,
+        })
+    );
+}
+
+void
+gba_send_settings_time_stretch(
+    struct gba *gba,
+    bool time_stretch
+) {
+    gba_message_push(
+        gba,
+        (struct message *)&((struct message_time_stretch) {
+            .super = (struct message){
+                .type = MESSAGE_SETTINGS_TIME_STRETCH,
+                .size = sizeof(struct message_time_stretch),
+            },
+            .time_stretch = time_stretch,
+        })
+    );
+}
+
 void
 gba_send_settings_rtc(
     struct gba *gba,
@@ -75,6 +75,42 @@ mem_io_dma_ctl_write8(
     }
 }
 
+/*
+** Run a Direct Sound DMA transfer, refilling the given FIFO.
+**
+** The words read are pushed straight into the FIFO instead of going through `mem_write32()` and
+** the IO registers, but the bus is still charged for each access like any other transfer.
+*/
+static
+void
+dma_run_fifo(
+    struct gba *gba,
+    struct dma_channel *channel,
+    enum fifo_idx fifo_idx,
+    int32_t src_step
+) {
+    enum access_types access;
+
+    access = NON_SEQUENTIAL;
+    while (channel->internal_count > 0 && !gba->core.reenter_dma_transfer_loop) {
+        if (likely(channel->internal_src >= EWRAM_START)) {
+            channel->bus = mem_read32(gba, channel->internal_src, access);
+        } else {
+            core_idle(gba);
+        }
+
+#ifdef WITH_DEBUGGER
+        debugger_eval_write_watchpoints(gba, channel->internal_dst, sizeof(uint32_t), channel->bus);
+#endif
+
+        mem_access(gba, channel->internal_dst, sizeof(uint32_t), access);
+        apu_fifo_write32(gba, fifo_idx, channel->bus);
+        channel->internal_src += src_step;
+        channel->internal_count -= 1;
+        access = SEQUENTIAL;
+    }
+}
+
 /*
 ** Run a single DMA transfer.
 */
@@ -122,7 +158,11 @@ dma_run_channel(
     );
 
     access = NON_SEQUENTIAL;
-    if (unit_size == 4) {
+    if (channel->is_fifo && unit_size == 4 && channel->internal_dst == IO_REG_FIFO_A_L) {
+        dma_run_fifo(gba, channel, FIFO_A, src_step);
+    } else if (channel->is_fifo && unit_size == 4 && channel->internal_dst == IO_REG_FIFO_B_L) {
+        dma_run_fifo(gba, channel, FIFO_B, src_step);
+    } else if (unit_size == 4) {
         while (channel->internal_count > 0 && !gba->core.reenter_dma_transfer_loop) {
             if (likely(channel->internal_src >= EWRAM_START)) {
                 channel->bus = mem_read32(gba, channel->internal_src, access);
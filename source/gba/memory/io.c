@@ -196,7 +196,21 @@ mem_io_read8(
         case IO_REG_BLDALPHA + 1:           return (io->bldalpha.bytes[1]);
 
         /* Sound */
-        case IO_REG_SOUND3CNT_L:            return (io->sound3cnt_l.bytes[0]);
+        case IO_REG_SOUND1CNT_L:            return (io->sound1cnt_l.bytes[0] & 0x7F);
+        case IO_REG_SOUND1CNT_L + 1:        return (0);
+        case IO_REG_SOUND1CNT_H:            return (io->tone_duty[0].bytes[0] & 0xC0);
+        case IO_REG_SOUND1CNT_H + 1:        return (io->tone_duty[0].bytes[1]);
+        case IO_REG_SOUND1CNT_X:            return (0);
+        case IO_REG_SOUND1CNT_X + 1:        return (io->tone_freq[0].bytes[1] & 0x40);
+        case IO_REG_SOUND1CNT_X + 2:
+        case IO_REG_SOUND1CNT_X + 3:        return (0);
+        case IO_REG_SOUND2CNT_L:            return (io->tone_duty[1].bytes[0] & 0xC0);
+        case IO_REG_SOUND2CNT_L + 1:        return (io->tone_duty[1].bytes[1]);
+        case IO_REG_SOUND2CNT_H:            return (0);
+        case IO_REG_SOUND2CNT_H + 1:        return (io->tone_freq[1].bytes[1] & 0x40);
+        case IO_REG_SOUND2CNT_H + 2:
+        case IO_REG_SOUND2CNT_H + 3:        return (0);
+        case IO_REG_SOUND3CNT_L:            return ((io->sound3cnt_l.bytes[0] & ~0x40) | (apu_wave_bank(gba) << 6));
         case IO_REG_SOUND3CNT_L + 1:        return (io->sound3cnt_l.bytes[1]);
         case IO_REG_SOUND3CNT_H:            return (io->sound3cnt_h.bytes[0]);
         case IO_REG_SOUND3CNT_H + 1:        return (io->sound3cnt_h.bytes[1]);
@@ -204,6 +218,14 @@ mem_io_read8(
         case IO_REG_SOUND3CNT_X + 1:        return (io->sound3cnt_x.bytes[1]);
         case IO_REG_SOUND3CNT_X + 2:
         case IO_REG_SOUND3CNT_X + 3:        return (0);
+        case IO_REG_SOUND4CNT_L:            return (0);
+        case IO_REG_SOUND4CNT_L + 1:        return (io->sound4cnt_l.bytes[1]);
+        case IO_REG_SOUND4CNT_L + 2:
+        case IO_REG_SOUND4CNT_L + 3:        return (0);
+        case IO_REG_SOUND4CNT_H:            return (io->sound4cnt_h.bytes[0]);
+        case IO_REG_SOUND4CNT_H + 1:        return (io->sound4cnt_h.bytes[1] & 0x40);
+        case IO_REG_SOUND4CNT_H + 2:
+        case IO_REG_SOUND4CNT_H + 3:        return (0);
         case IO_REG_SOUNDCNT_L:             return (io->soundcnt_l.bytes[0]);
         case IO_REG_SOUNDCNT_L + 1:         return (io->soundcnt_l.bytes[1]);
         case IO_REG_SOUNDCNT_H:             return (io->soundcnt_h.bytes[0]);
@@ -231,7 +253,7 @@ mem_io_read8(
         case IO_REG_WAVE_RAM3 + 0:
         case IO_REG_WAVE_RAM3 + 1:
         case IO_REG_WAVE_RAM3 + 2:
-        case IO_REG_WAVE_RAM3 + 3:          return (io->waveram[!io->sound3cnt_l.bank_select][addr - IO_REG_WAVE_RAM0]);
+        case IO_REG_WAVE_RAM3 + 3:          return (io->waveram[!apu_wave_bank(gba)][addr - IO_REG_WAVE_RAM0]);
 
         /* DMA */
         case IO_REG_DMA0CNT:
@@ -436,15 +458,55 @@ mem_io_write8(
         case IO_REG_BLDY + 1:               io->bldy.bytes[1] = val; break;
 
         /* Sound */
+        case IO_REG_SOUND1CNT_L:            io->sound1cnt_l.bytes[0] = val & 0x7F; break;
+        case IO_REG_SOUND1CNT_L + 1:        break;
+        case IO_REG_SOUND1CNT_H:            io->tone_duty[0].bytes[0] = val; apu_log_change(gba); break;
+        case IO_REG_SOUND1CNT_H + 1: {
+            io->tone_duty[0].bytes[1] = val;
+            if (!io->tone_duty[0].envelope_volume && !io->tone_duty[0].envelope_direction) {
+                apu_psg_stop(gba, PSG_TONE_1);
+            }
+            break;
+        };
+        case IO_REG_SOUND1CNT_X:            io->tone_freq[0].bytes[0] = val; apu_log_change(gba); break;
+        case IO_REG_SOUND1CNT_X + 1: {
+            io->tone_freq[0].bytes[1] = val;
+            if (io->tone_freq[0].reset) {
+                apu_tone_reset(gba, PSG_TONE_1);
+            } else {
+                apu_log_change(gba);
+            }
+            break;
+        };
+        case IO_REG_SOUND2CNT_L:            io->tone_duty[1].bytes[0] = val; apu_log_change(gba); break;
+        case IO_REG_SOUND2CNT_L + 1: {
+            io->tone_duty[1].bytes[1] = val;
+            if (!io->tone_duty[1].envelope_volume && !io->tone_duty[1].envelope_direction) {
+                apu_psg_stop(gba, PSG_TONE_2);
+            }
+            break;
+        };
+        case IO_REG_SOUND2CNT_H:            io->tone_freq[1].bytes[0] = val; apu_log_change(gba); break;
+        case IO_REG_SOUND2CNT_H + 1: {
+            io->tone_freq[1].bytes[1] = val;
+            if (io->tone_freq[1].reset) {
+                apu_tone_reset(gba, PSG_TONE_2);
+            } else {
+                apu_log_change(gba);
+            }
+            break;
+        };
         case IO_REG_SOUND3CNT_L: {
+            apu_wave_sync(gba);
             io->sound3cnt_l.bytes[0] = val;
             if (!io->sound3cnt_l.enable) {
                 apu_wave_stop(gba);
             }
+            apu_log_change(gba);
         };
         case IO_REG_SOUND3CNT_L + 1:        io->sound3cnt_l.bytes[1] = val; break;
         case IO_REG_SOUND3CNT_H:            io->sound3cnt_h.bytes[0] = val; break;
-        case IO_REG_SOUND3CNT_H + 1:        io->sound3cnt_h.bytes[1] = val; break;
+        case IO_REG_SOUND3CNT_H + 1:        io->sound3cnt_h.bytes[1] = val; apu_log_change(gba); break;
         case IO_REG_SOUND3CNT_X:            io->sound3cnt_x.bytes[0] = val; break;
         case IO_REG_SOUND3CNT_X + 1: {
             io->sound3cnt_x.bytes[1] = val;
@@ -454,11 +516,29 @@ mem_io_write8(
             io->sound3cnt_x.reset = false;
             break;
         };
-        case IO_REG_SOUNDCNT_L:             io->soundcnt_l.bytes[0] = val; break;
-        case IO_REG_SOUNDCNT_L + 1:         io->soundcnt_l.bytes[1] = val; break;
-        case IO_REG_SOUNDCNT_H:             io->soundcnt_h.bytes[0] = val & 0x0F; break;
+        case IO_REG_SOUND4CNT_L:            io->sound4cnt_l.bytes[0] = val; break;
+        case IO_REG_SOUND4CNT_L + 1: {
+            io->sound4cnt_l.bytes[1] = val;
+            if (!io->sound4cnt_l.envelope_volume && !io->sound4cnt_l.envelope_direction) {
+                apu_psg_stop(gba, PSG_NOISE);
+            }
+            break;
+        };
+        case IO_REG_SOUND4CNT_H:            io->sound4cnt_h.bytes[0] = val; apu_log_change(gba); break;
+        case IO_REG_SOUND4CNT_H + 1: {
+            io->sound4cnt_h.bytes[1] = val;
+            if (io->sound4cnt_h.reset) {
+                apu_noise_reset(gba);
+            }
+            break;
+        };
+        case IO_REG_SOUNDCNT_L:             io->soundcnt_l.bytes[0] = val; apu_log_change(gba); break;
+        case IO_REG_SOUNDCNT_L + 1:         io->soundcnt_l.bytes[1] = val; apu_log_change(gba); break;
+        case IO_REG_SOUNDCNT_H:             io->soundcnt_h.bytes[0] = val & 0x0F; apu_log_change(gba); break;
         case IO_REG_SOUNDCNT_H + 1: {
             io->soundcnt_h.bytes[1] = val;
+            apu_update_timer_fifos(gba);
+            apu_log_change(gba);
 
             if (io->soundcnt_h.reset_fifo_a) {
                 apu_reset_fifo(gba, FIFO_A);
@@ -477,24 +557,35 @@ mem_io_write8(
 
             old_master = io->soundcnt_x.bytes[0] & 0x80;
             io->soundcnt_x.bytes[0] = val & 0x80;
+            apu_update_timer_fifos(gba);
 
             if (old_master && !io->soundcnt_x.master_enable) {
                 apu_reset_fifo(gba, 0);
                 apu_reset_fifo(gba, 1);
                 apu_wave_stop(gba);
+                apu_psg_stop(gba, PSG_TONE_1);
+                apu_psg_stop(gba, PSG_TONE_2);
+                apu_psg_stop(gba, PSG_NOISE);
 
                 /*
                 ** Registers 0x4000060 to 0x4000081 are reset.
                 */
 
+                io->sound1cnt_l.raw = 0;
+                io->tone_duty[0].raw = 0;
+                io->tone_duty[1].raw = 0;
+                io->tone_freq[0].raw = 0;
+                io->tone_freq[1].raw = 0;
+                io->sound4cnt_l.raw = 0;
+                io->sound4cnt_h.raw = 0;
                 io->sound3cnt_l.raw = 0;
                 io->sound3cnt_h.raw = 0;
                 io->sound3cnt_x.raw = 0;
             }
             break;
         };
-        case IO_REG_SOUNDBIAS:              io->soundbias.bytes[0] = val; break;
-        case IO_REG_SOUNDBIAS + 1:          io->soundbias.bytes[1] = val; break;
+        case IO_REG_SOUNDBIAS:              io->soundbias.bytes[0] = val; apu_log_change(gba); break;
+        case IO_REG_SOUNDBIAS + 1:          io->soundbias.bytes[1] = val; apu_log_change(gba); break;
         case IO_REG_SOUNDBIAS + 2:          io->soundbias.bytes[2] = val; break;
         case IO_REG_SOUNDBIAS + 3:          io->soundbias.bytes[3] = val; break;
         case IO_REG_WAVE_RAM0 + 0:
@@ -513,7 +604,9 @@ mem_io_write8(
         case IO_REG_WAVE_RAM3 + 1:
         case IO_REG_WAVE_RAM3 + 2:
         case IO_REG_WAVE_RAM3 + 3: {
+            apu_wave_sync(gba);
             io->waveram[!io->sound3cnt_l.bank_select][addr - IO_REG_WAVE_RAM0] = val;
+            apu_log_change(gba);
             break;
         };
         case IO_REG_FIFO_A_L + 0:
@@ -68,6 +68,34 @@ mem_reset(
     memory->eeprom.transfer_address = 0;
     memory->eeprom.transfer_data = 0;
     memory->eeprom.transfer_len = 0;
+    mem_invalidate_display_caches(memory);
+}
+
+/*
+** Mark all the caches derived from the display memory as outdated.
+**
+** This must be called every time PALRAM, VRAM or OAM is modified without going through `mem_write*()`,
+** like when a quicksave is loaded.
+*/
+void
+mem_invalidate_display_caches(
+    struct memory *memory
+) {
+    size_t i;
+
+    memset(memory->vram_tiles_dirty, 0xFF, sizeof(memory->vram_tiles_dirty));
+
+    // Generations start at 1, so this forces the sprites to be decoded again.
+    memory->oam_sprites_gen = 0;
+
+    ++memory->display_gen;
+    for (i = 0; i < array_length(memory->vram_gen); ++i) {
+        memory->vram_gen[i] = memory->display_gen;
+    }
+    for (i = 0; i < array_length(memory->palram_gen); ++i) {
+        memory->palram_gen[i] = memory->display_gen;
+    }
+    memory->oam_gen = memory->display_gen;
 }
 
 /*
@@ -378,6 +406,24 @@ mem_openbus_read(
         _ret;                                                                               \
     })
 
+/*
+** Store `val` at `ptr` and return `true` if that modified the value stored there.
+**
+** Used for the display memory, which generations must only move forward when it actually changes.
+*/
+#define mem_display_store(ptr, val)                                                             \
+    ({                                                                                          \
+        typeof(ptr) _store_ptr;                                                                 \
+        typeof(*_store_ptr) _store_val;                                                         \
+        bool _changed;                                                                          \
+                                                                                                \
+        _store_ptr = (ptr);                                                                     \
+        _store_val = (val);                                                                     \
+        _changed = (*_store_ptr != _store_val);                                                 \
+        *_store_ptr = _store_val;                                                               \
+        _changed;                                                                               \
+    })
+
 /*
 ** Wriote a data of type T to memory at the given address.
 **
@@ -418,27 +464,42 @@ mem_openbus_read(
             case PALRAM_REGION: {                                                               \
                 _Generic(val,                                                                   \
                     uint32_t: ({                                                                \
-                        *(T *)((uint8_t *)((gba)->memory.palram) + (_addr & PALRAM_MASK)) = (T)(val); \
+                        if (mem_display_store((T *)((uint8_t *)((gba)->memory.palram) + (_addr & PALRAM_MASK)), (T)(val))) { \
+                            mem_palram_touch((gba), _addr);                                     \
+                        }                                                                       \
                     }),                                                                         \
                     uint16_t: ({                                                                \
-                        *(T *)((uint8_t *)((gba)->memory.palram) + (_addr & PALRAM_MASK)) = (T)(val); \
+                        if (mem_display_store((T *)((uint8_t *)((gba)->memory.palram) + (_addr & PALRAM_MASK)), (T)(val))) { \
+                            mem_palram_touch((gba), _addr);                                     \
+                        }                                                                       \
                     }),                                                                         \
                     default: ({                                                                 \
                         /* u8 writes to PALRAM are writting to both the upper/lower bytes */    \
                         addr &= ~(sizeof(uint16_t) - 1);                                        \
-                        *(T *)((uint8_t *)((gba)->memory.palram) + (_addr & PALRAM_MASK)) = (T)(val); \
-                        *(T *)((uint8_t *)((gba)->memory.palram) + ((_addr + 1) & PALRAM_MASK)) = (T)(val); \
+                        if (mem_display_store((T *)((uint8_t *)((gba)->memory.palram) + (_addr & PALRAM_MASK)), (T)(val))) { \
+                            mem_palram_touch((gba), _addr);                                     \
+                        }                                                                       \
+                        if (mem_display_store((T *)((uint8_t *)((gba)->memory.palram) + ((_addr + 1) & PALRAM_MASK)), (T)(val))) { \
+                            mem_palram_touch((gba), _addr + 1);                                 \
+                        }                                                                       \
                     })                                                                          \
                 );                                                                              \
                 break;                                                                          \
             };                                                                                  \
             case VRAM_REGION: {                                                                 \
+                ppu_render_sync_vram((gba), mem_vram_offset(_addr));                            \
                 _Generic(val,                                                                   \
                     uint32_t: ({                                                                \
-                        *(T *)((uint8_t *)((gba)->memory.vram) + (_addr & ((_addr & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2))) = (T)(val); \
+                        if (mem_display_store((T *)((uint8_t *)((gba)->memory.vram) + mem_vram_offset(_addr)), (T)(val))) { \
+                            mem_vram_invalidate_tile((gba), mem_vram_offset(_addr));            \
+                            mem_vram_touch((gba), mem_vram_offset(_addr));                      \
+                        }                                                                       \
                     }),                                                                         \
                     uint16_t: ({                                                                \
-                        *(T *)((uint8_t *)((gba)->memory.vram) + (_addr & ((_addr & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2))) = (T)(val); \
+                        if (mem_display_store((T *)((uint8_t *)((gba)->memory.vram) + mem_vram_offset(_addr)), (T)(val))) { \
+                            mem_vram_invalidate_tile((gba), mem_vram_offset(_addr));            \
+                            mem_vram_touch((gba), mem_vram_offset(_addr));                      \
+                        }                                                                       \
                     }),                                                                         \
                     default: ({                                                                 \
                         uint32_t new_addr;                                                      \
@@ -453,8 +514,14 @@ mem_openbus_read(
                             || ((gba)->io.dispcnt.bg_mode >= 3 && (new_addr) < 0x14000)         \
                         ) {                                                                     \
                             addr &= ~(sizeof(uint16_t) - 1);                                    \
-                            *(T *)((uint8_t *)((gba)->memory.vram) + (_addr & ((_addr & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2))) = (T)(val); \
-                            *(T *)((uint8_t *)((gba)->memory.vram) + ((_addr + 1) & (((_addr + 1) & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2))) = (T)(val); \
+                            if (mem_display_store((T *)((uint8_t *)((gba)->memory.vram) + mem_vram_offset(_addr)), (T)(val))) { \
+                                mem_vram_invalidate_tile((gba), mem_vram_offset(_addr));        \
+                                mem_vram_touch((gba), mem_vram_offset(_addr));                  \
+                            }                                                                   \
+                            if (mem_display_store((T *)((uint8_t *)((gba)->memory.vram) + mem_vram_offset(_addr + 1)), (T)(val))) { \
+                                mem_vram_invalidate_tile((gba), mem_vram_offset(_addr + 1));    \
+                                mem_vram_touch((gba), mem_vram_offset(_addr + 1));              \
+                            }                                                                   \
                         }                                                                       \
                     })                                                                          \
                 );                                                                              \
@@ -463,10 +530,14 @@ mem_openbus_read(
             case OAM_REGION: {                                                                  \
                 _Generic(val,                                                                   \
                     uint32_t: ({                                                                \
-                        *(T *)((uint8_t *)((gba)->memory.oam) + (_addr & OAM_MASK)) = (T)(val); \
+                        if (mem_display_store((T *)((uint8_t *)((gba)->memory.oam) + (_addr & OAM_MASK)), (T)(val))) { \
+                            mem_oam_touch((gba));                                               \
+                        }                                                                       \
                     }),                                                                         \
                     uint16_t: ({                                                                \
-                        *(T *)((uint8_t *)((gba)->memory.oam) + (_addr & OAM_MASK)) = (T)(val); \
+                        if (mem_display_store((T *)((uint8_t *)((gba)->memory.oam) + (_addr & OAM_MASK)), (T)(val))) { \
+                            mem_oam_touch((gba));                                               \
+                        }                                                                       \
                     }),                                                                         \
                     default: ({                                                                 \
                         /* Ignore u8 write attemps to OAM memory */                             \
@@ -36,6 +36,12 @@ ppu_step_affine_internal_registers(
     }
 }
 
+/*
+** Render the given line of an affine background.
+**
+** Affine backgrounds are always 128, 256, 512 or 1024 pixels wide and tall, so wrapping
+** around the edges of the background is a simple mask.
+*/
 void
 ppu_render_background_affine(
     struct gba *gba,
@@ -43,28 +49,28 @@ ppu_render_background_affine(
     uint32_t line,
     uint32_t bg_idx
 ) {
+    uint8_t const *chrs;
     uint32_t screen_addr;
     uint32_t chrs_addr;
+    uint32_t map_shift;
     int16_t pa;
     int16_t pc;
     int32_t px;
     int32_t py;
     int32_t bg_size;
+    int32_t bg_mask;
     uint32_t x;
     struct io const *io;
 
-    io = &gba->io;
+    io = &scanline->io;
     scanline->top_idx = bg_idx;
 
-    switch (gba->io.bgcnt[bg_idx].size) {
-        case 0b00: bg_size = 128; break;
-        case 0b01: bg_size = 256; break;
-        case 0b10: bg_size = 512; break;
-        case 0b11: bg_size = 1024; break;
-    }
+    bg_size = 128 << io->bgcnt[bg_idx].size;
+    bg_mask = bg_size - 1;
+    map_shift = 4 + io->bgcnt[bg_idx].size; // log2(bg_size / 8)
 
-    px = gba->ppu.internal_px[bg_idx % 2];
-    py = gba->ppu.internal_py[bg_idx % 2];
+    px = scanline->internal_px[bg_idx % 2];
+    py = scanline->internal_py[bg_idx % 2];
 
     pa = (int16_t)io->bg_pa[bg_idx % 2].raw;
     pc = (int16_t)io->bg_pc[bg_idx % 2].raw;
@@ -72,34 +78,32 @@ ppu_render_background_affine(
     screen_addr = (uint32_t)io->bgcnt[bg_idx].screen_base * 0x800;
     chrs_addr = (uint32_t)io->bgcnt[bg_idx].character_base * 0x4000;
 
+    // The character data of a tile never crosses the end of the background VRAM.
+    chrs = gba->memory.vram + chrs_addr;
+
     for (x = 0; x < GBA_SCREEN_WIDTH; ++x, px += pa, py += pc) {
         uint32_t palette_idx;
         uint32_t tile_idx;
         int32_t tile_x;
         int32_t tile_y;
-        uint32_t chr_x;
-        uint32_t chr_y;
 
         tile_x = px >> 8;
         tile_y = py >> 8;
 
         if (io->bgcnt[bg_idx].wrap) {
-            tile_x = tile_x >= 0 ? (tile_x % bg_size) : (bg_size + (tile_x % bg_size));
-            tile_y = tile_y >= 0 ? (tile_y % bg_size) : (bg_size + (tile_y % bg_size));
-        } else if (tile_x < 0 || tile_x >= bg_size || tile_y < 0 || tile_y >= bg_size) {
+            tile_x &= bg_mask;
+            tile_y &= bg_mask;
+        } else if ((uint32_t)tile_x >= (uint32_t)bg_size || (uint32_t)tile_y >= (uint32_t)bg_size) {
             continue;
         }
 
-        chr_x = tile_x % 8;
-        chr_y = tile_y % 8;
-
-        tile_idx = mem_vram_read8(gba, screen_addr + (tile_y / 8) * (bg_size / 8) + (tile_x / 8));
-        palette_idx = mem_vram_read8(gba, chrs_addr + tile_idx * 64 + chr_y * 8 + chr_x);
+        tile_idx = mem_vram_read8(gba, screen_addr + (((uint32_t)tile_y / 8) << map_shift) + (uint32_t)tile_x / 8);
+        palette_idx = chrs[tile_idx * 64 + (tile_y % 8) * 8 + (tile_x % 8)];
 
         if (palette_idx) {
             struct rich_color c;
 
-            c.raw = mem_palram_read16(gba, palette_idx * sizeof(union color));
+            c.raw = ppu_palram_read16(scanline, palette_idx * sizeof(union color));
             c.visible = true;
             c.idx = bg_idx;
             c.force_blend = false;
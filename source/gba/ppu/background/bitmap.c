@@ -25,15 +25,58 @@ ppu_render_background_bitmap(
     struct rich_color c;
     struct io const *io;
 
-    io = &gba->io;
+    io = &scanline->io;
     scanline->top_idx = 2;
 
-    px = gba->ppu.internal_px[0];
-    py = gba->ppu.internal_py[0];
+    px = scanline->internal_px[0];
+    py = scanline->internal_py[0];
 
     pa = (int16_t)io->bg_pa[0].raw;
     pc = (int16_t)io->bg_pc[0].raw;
 
+    /*
+    ** Fast path for the common case where the background is neither rotated nor scaled:
+    ** the line is then a contiguous part of a single row of the bitmap.
+    */
+    if (pa == 0x100 && pc == 0) {
+        int32_t rel_y;
+        int32_t x_start;
+        int32_t x_end;
+
+        rel_y = py >> 8;
+        if (rel_y < 0 || rel_y >= GBA_SCREEN_HEIGHT) {
+            return ;
+        }
+
+        x_start = max(0, -(px >> 8));
+        x_end = min(GBA_SCREEN_WIDTH, GBA_SCREEN_WIDTH - (px >> 8));
+
+        c.visible = true;
+        c.idx = 2;
+        c.force_blend = false;
+
+        if (palette) {
+            uint8_t const *row;
+
+            row = gba->memory.vram + 0xA000 * io->dispcnt.frame + GBA_SCREEN_WIDTH * rel_y + (px >> 8);
+            for (x = x_start; (int32_t)x < x_end; ++x) {
+                if (row[x]) {
+                    c.raw = ppu_palram_read16(scanline, row[x] * sizeof(union color));
+                    scanline->bg[x] = c;
+                }
+            }
+        } else {
+            uint16_t const *row;
+
+            row = (uint16_t const *)gba->memory.vram + GBA_SCREEN_WIDTH * rel_y + (px >> 8);
+            for (x = x_start; (int32_t)x < x_end; ++x) {
+                c.raw = row[x];
+                scanline->bg[x] = c;
+            }
+        }
+        return ;
+    }
+
     for (x = 0; x < GBA_SCREEN_WIDTH; ++x, px += pa, py += pc) {
         int32_t rel_x;
         int32_t rel_y;
@@ -52,9 +95,9 @@ ppu_render_background_bitmap(
         if (palette) {
             uint8_t palette_idx;
 
-            palette_idx = mem_vram_read8(gba, (GBA_SCREEN_WIDTH * rel_y + rel_x) + 0xA000 * gba->io.dispcnt.frame);
+            palette_idx = mem_vram_read8(gba, (GBA_SCREEN_WIDTH * rel_y + rel_x) + 0xA000 * io->dispcnt.frame);
             if (palette_idx) {
-                c.raw = mem_palram_read16(gba, palette_idx * sizeof(union color));
+                c.raw = ppu_palram_read16(scanline, palette_idx * sizeof(union color));
                 c.visible = true;
                 c.idx = 2;
                 c.force_blend = false;
@@ -83,15 +126,42 @@ ppu_render_background_bitmap_small(
     struct rich_color c;
     struct io const *io;
 
-    io = &gba->io;
+    io = &scanline->io;
     scanline->top_idx = 2;
 
-    px = gba->ppu.internal_px[0];
-    py = gba->ppu.internal_py[0];
+    px = scanline->internal_px[0];
+    py = scanline->internal_py[0];
 
     pa = (int16_t)io->bg_pa[0].raw;
     pc = (int16_t)io->bg_pc[0].raw;
 
+    // Fast path for backgrounds that are neither rotated nor scaled, see `ppu_render_background_bitmap()`.
+    if (pa == 0x100 && pc == 0) {
+        uint16_t const *row;
+        int32_t rel_y;
+        int32_t x_start;
+        int32_t x_end;
+
+        rel_y = py >> 8;
+        if (rel_y < 0 || rel_y >= 160) {
+            return ;
+        }
+
+        x_start = max(0, -(px >> 8));
+        x_end = min(GBA_SCREEN_WIDTH, 160 - (px >> 8));
+
+        c.visible = true;
+        c.idx = 2;
+        c.force_blend = false;
+
+        row = (uint16_t const *)(gba->memory.vram + 0xA000 * io->dispcnt.frame) + 160 * rel_y + (px >> 8);
+        for (x = x_start; (int32_t)x < x_end; ++x) {
+            c.raw = row[x];
+            scanline->bg[x] = c;
+        }
+        return ;
+    }
+
     for (x = 0; x < GBA_SCREEN_WIDTH; ++x, px += pa, py += pc) {
         int32_t rel_x;
         int32_t rel_y;
@@ -107,7 +177,7 @@ ppu_render_background_bitmap_small(
             continue;
         }
 
-        c.raw = mem_vram_read16(gba, 0xA000 * gba->io.dispcnt.frame + (160 * rel_y + rel_x) * sizeof(union color) );
+        c.raw = mem_vram_read16(gba, 0xA000 * io->dispcnt.frame + (160 * rel_y + rel_x) * sizeof(union color) );
         c.visible = true;
         c.idx = 2;
         c.force_blend = false;
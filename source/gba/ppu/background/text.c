@@ -15,7 +15,7 @@
 */
 void
 ppu_render_background_text(
-    struct gba const *gba,
+    struct gba *gba,
     struct scanline *scanline,
     uint32_t line,
     uint32_t bg_idx
@@ -31,8 +31,12 @@ ppu_render_background_text(
     uint32_t tile_y;        // Y coord of the tile in the tilemap
     uint32_t chr_y;         // Y coord of the pixel we want to render within the tile
     bool up_y;
+    uint32_t cur_screen_idx;
+    uint8_t const *row;     // The 8 pixels (one palette index per byte) of the current tile's row
+    uint32_t row_hflip;
+    uint32_t row_palette;
 
-    io = &gba->io;
+    io = &scanline->io;
     scanline->top_idx = bg_idx;
 
     /* Retrieve all those before so that we don't have to read them for each pixel. */
@@ -46,35 +50,27 @@ ppu_render_background_text(
     ** Do all the maths for the Y coordinate first, since those do not change until the next scanline.
     */
 
-    if (mosaic) {
-        rel_y = line / (io->mosaic.bg_vsize + 1) * (io->mosaic.bg_vsize + 1);
-    } else {
-        rel_y = line;
-    }
-    rel_y += io->bg_voffset[bg_idx].raw;
+    rel_y = (mosaic ? gba->mosaic.bg_y[line] : line) + io->bg_voffset[bg_idx].raw;
     tile_y = (rel_y / 8);
     up_y = tile_y & 0b100000;
     tile_y %= 32;
     chr_y = rel_y % 8;
 
+    row = NULL;
+    row_hflip = 0;
+    row_palette = 0;
+    cur_screen_idx = UINT32_MAX;
+
     /* Now iterate for each pixels of this scanline. */
     for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
         int32_t rel_x;          // X coord of the pixel within the bg
         uint32_t tile_x;        // X coord of the tile in the tilemap
         uint32_t chr_x;         // X coord of the pixel we want to render within the tile
-        uint32_t chr_vy;        // Y coord of the pixel we want to render within the tile
         uint32_t screen_idx;
         uint8_t palette_idx;
-        union tile tile;
         bool up_x;
 
-        if (mosaic) {
-            rel_x = x / (io->mosaic.bg_hsize + 1) * (io->mosaic.bg_hsize + 1);
-        } else {
-            rel_x = x;
-        }
-
-        rel_x += io->bg_hoffset[bg_idx].raw;
+        rel_x = x + io->bg_hoffset[bg_idx].raw;
 
         tile_x = (rel_x / 8);
         up_x = tile_x & 0b100000;
@@ -96,33 +92,33 @@ ppu_render_background_text(
                 break;
         }
 
-        tile.raw = mem_vram_read16(gba, screen_addr + screen_idx * sizeof(union tile));
-        chr_vy = chr_y ^ tile.vflip * 0b111;
-        chr_x ^= tile.hflip * 0b111;
-
-        if (palette_type) { // 256 colors, 1 palette
-            palette_idx = mem_vram_read8(gba, chrs_addr + tile.number * 64 + chr_vy * 8 + chr_x);
-        } else { // 16 colors, 16 palettes
-
-            /*
-            ** In this mode, each byte represents two pixels:
-            **   * The lower 4 bits define the color of the left pixel
-            **   * The upper 4 bits define the color of the right pixel
-            */
-
-            palette_idx = mem_vram_read8(gba, chrs_addr + tile.number * 32 + chr_vy * 4 + (chr_x >> 1));
-            palette_idx >>= (chr_x % 2) * 4;
-            palette_idx &= 0xF;
+        /*
+        ** Fetch the tile and the row of pixels we are interested in only when we move to a new tile.
+        */
+        if (screen_idx != cur_screen_idx) {
+            union tile tile;
+            uint32_t chr_vy;
+
+            cur_screen_idx = screen_idx;
+            tile.raw = mem_vram_read16(gba, screen_addr + screen_idx * sizeof(union tile));
+            chr_vy = chr_y ^ tile.vflip * 0b111;
+
+            if (palette_type) { // 256 colors, 1 palette
+                row = gba->memory.vram + mem_vram_offset(chrs_addr + tile.number * 64 + chr_vy * 8);
+                row_palette = 0;
+            } else { // 16 colors, 16 palettes
+                row = ppu_tile4_pixels(gba, mem_vram_offset(chrs_addr + tile.number * 32)) + chr_vy * 8;
+                row_palette = tile.palette * 16;
+            }
+            row_hflip = tile.hflip * 0b111;
         }
 
+        palette_idx = row[chr_x ^ row_hflip];
+
         if (palette_idx) {
             struct rich_color c;
 
-            c.raw = mem_palram_read16(
-                gba,
-                (tile.palette * 16 * !palette_type + palette_idx) * sizeof(union color)
-            );
-
+            c.raw = ppu_palram_read16(scanline, (row_palette + palette_idx) * sizeof(union color));
             c.visible = true;
             c.idx = bg_idx;
             c.force_blend = false;
@@ -131,4 +127,18 @@ ppu_render_background_text(
             scanline->bg[x].visible = false;
         }
     }
+
+    /* Apply the horizontal mosaic by repeating the first pixel of each block. */
+    if (mosaic && io->mosaic.bg_hsize) {
+        uint32_t size;
+
+        size = io->mosaic.bg_hsize + 1;
+        for (x = 0; x < GBA_SCREEN_WIDTH; x += size) {
+            uint32_t i;
+
+            for (i = x + 1; i < x + size && i < GBA_SCREEN_WIDTH; ++i) {
+                scanline->bg[i] = scanline->bg[x];
+            }
+        }
+    }
 }
@@ -25,67 +25,257 @@ int32_t sprite_size_x[16] = { 8, 16, 32, 64, 16, 32, 32, 64, 8, 8, 16, 32, 0, 0,
 int32_t sprite_size_y[16] = { 8, 16, 32, 64, 8, 8, 16, 32, 16, 32, 32, 64, 0, 0, 0, 0};
 
 /*
-** Pre-render all visible sprites.
+** Draw a single pixel of a sprite, if it isn't transparent, on the layer of its priority or on the
+** object window mask.
 */
+static inline
 void
-ppu_prerender_oam(
+ppu_draw_sprite_pixel(
+    struct gba const *gba,
+    struct scanline *scanline,
+    union oam_entry oam,
+    int32_t x,
+    uint32_t palette_idx
+) {
+    if (palette_idx) {
+        if (oam.mode == OAM_MODE_WINDOW) {
+            scanline->win_obj_mask[x] = true;
+        } else {
+            struct rich_color c;
+
+            // 16-bits palette mode
+            if (!oam.color_256) {
+                palette_idx += oam.palette_num * 16;
+            }
+
+            c.raw = ppu_palram_read16(scanline, 0x200 + palette_idx * sizeof(union color));
+            c.visible = true;
+            c.idx = 4;
+            c.force_blend = (oam.mode == OAM_MODE_BLEND);
+            scanline->oam[oam.priority][x] = c;
+        }
+    }
+}
+
+/*
+** Render the given line of a sprite that isn't affine.
+**
+** Such sprites are rendered tile by tile: the row of each tile is fetched once and flipped as a whole,
+** and the sprite is clipped against the edges of the screen only once.
+** Mosaic is applied afterwards using the lookup tables built by `ppu_update_mosaic()`.
+*/
+static
+void
+ppu_render_regular_sprite(
     struct gba *gba,
     struct scanline *scanline,
+    struct sprite const *sprite,
     int32_t line
 ) {
-    uint32_t bg_mode;
-    struct io const *io;
-    int32_t oam_idx;
+    union oam_entry oam;
+    uint8_t pixels[64];     // The row of the sprite, one palette index per byte, horizontal flip applied
+    uint32_t tile_size;     // In bytes
+    int32_t rel_y;          // Y coordinate of the row within the sprite
+    uint32_t tile_y;        // Y coordinate of the tile within the sprite
+    uint32_t chr_y;         // Y coordinate of the row within the tile (0-7)
+    uint32_t row_offset;    // Offset of the first tile of the row within VRAM, without the tile's X coordinate
+    int32_t x;
+    int32_t x_start;
+    int32_t x_end;
+    int32_t tile_x;
+    int32_t tile_end;
+
+    oam = sprite->oam;
+    tile_size = oam.color_256 ? 64 : 32;
+
+    rel_y = (oam.mosaic ? gba->mosaic.obj_y[line] : line) - sprite->win_oy;
+    if (rel_y < 0) {
+        return ;
+    }
 
-    io = &gba->io;
-    bg_mode = io->dispcnt.bg_mode;
+    tile_y = rel_y / 8;
+    chr_y = rel_y % 8;
 
-    if (!io->dispcnt.obj) {
+    // Flip vertically
+    if (oam.vflip) {
+        tile_y = (sprite->sprite_sy / 8) - 1 - tile_y;
+        chr_y ^= 0b111;
+    }
+
+    row_offset = 0x10000 + oam.tile_idx * 32;
+    if (scanline->io.dispcnt.obj_dim) { // 1 Dimension
+        row_offset += tile_y * (sprite->sprite_sx / 8) * tile_size;
+    } else { // 2 Dimension
+        row_offset += tile_y * 32 * 32;
+    }
+
+    // Clip the sprite against the screen
+    x_start = max(0, -sprite->win_ox);
+    x_end = min(sprite->win_sx, GBA_SCREEN_WIDTH - sprite->win_ox);
+
+    if (x_start >= x_end) {
         return ;
     }
 
-    for (oam_idx = 127; oam_idx >= 0; --oam_idx) {
-        union oam_entry oam;
-        int32_t x;
+    /*
+    ** Fetch the rows of the tiles that are visible, 8 pixels at a time.
+    ** With mosaic, pixels can be repeated from anywhere on their left.
+    */
+    tile_end = (x_end - 1) / 8;
+    for (tile_x = oam.mosaic ? 0 : x_start / 8; tile_x <= tile_end; ++tile_x) {
+        uint8_t const *src;
+        uint32_t tile_offset;
+        uint32_t i;
+
+        // Flip horizontally
+        if (oam.hflip) {
+            tile_offset = row_offset + ((sprite->sprite_sx / 8) - 1 - tile_x) * tile_size;
+        } else {
+            tile_offset = row_offset + tile_x * tile_size;
+        }
+
+        if (oam.color_256) { // 256 colors, 1 palette
+            src = gba->memory.vram + mem_vram_offset(tile_offset + chr_y * 8);
+        } else { // 16 colors, 16 palettes
+            src = ppu_tile4_pixels(gba, mem_vram_offset(tile_offset)) + chr_y * 8;
+        }
+
+        if (oam.hflip) {
+            for (i = 0; i < 8; ++i) {
+                pixels[tile_x * 8 + i] = src[7 - i];
+            }
+        } else {
+            memcpy(pixels + tile_x * 8, src, 8);
+        }
+    }
 
-        int32_t win_oy;
-        int32_t win_ox;
-        int32_t win_sx;
-        int32_t win_sy;
-        int32_t sprite_sx;
-        int32_t sprite_sy;
+    if (oam.mosaic) {
+        for (x = x_start; x < x_end; ++x) {
+            int32_t src_x;
 
-        oam.raw[0] = mem_oam_read16(gba, (oam_idx * 4 + 0) * 2);
-        oam.raw[1] = mem_oam_read16(gba, (oam_idx * 4 + 1) * 2);
-        oam.raw[2] = mem_oam_read16(gba, (oam_idx * 4 + 2) * 2);
+            src_x = gba->mosaic.obj_x[sprite->win_ox + x] - sprite->win_ox;
+            if (src_x >= 0) {
+                ppu_draw_sprite_pixel(gba, scanline, oam, sprite->win_ox + x, pixels[src_x]);
+            }
+        }
+    } else {
+        for (x = x_start; x < x_end; ++x) {
+            ppu_draw_sprite_pixel(gba, scanline, oam, sprite->win_ox + x, pixels[x]);
+        }
+    }
+}
+
+/*
+** Decode all the OAM entries the given scanline is rendered with into `memory.oam_sprites` and sort
+** them by the scanlines they cover.
+*/
+static
+void
+ppu_decode_oam(
+    struct gba *gba,
+    struct scanline const *scanline
+) {
+    int32_t oam_idx;
+
+    memset(gba->memory.oam_sprites_per_line, 0, sizeof(gba->memory.oam_sprites_per_line));
+
+    for (oam_idx = 0; oam_idx < 128; ++oam_idx) {
+        struct sprite *sprite;
+        union oam_entry *oam;
+        int32_t line;
+        int32_t end;
+
+        sprite = &gba->memory.oam_sprites[oam_idx];
+        oam = &sprite->oam;
+
+        oam->raw[0] = ppu_oam_read16(scanline, (oam_idx * 4 + 0) * 2);
+        oam->raw[1] = ppu_oam_read16(scanline, (oam_idx * 4 + 1) * 2);
+        oam->raw[2] = ppu_oam_read16(scanline, (oam_idx * 4 + 2) * 2);
 
         // Skip OAM entries that should'nt be displayed
-        if (!oam.affine && oam.virt_dsize) {
+        if (!oam->affine && oam->virt_dsize) {
             continue;
         }
 
-        // Skip OAM entries of index < 512 for BG mode 3-5
-        if (bg_mode >= 3 && bg_mode <= 5 && oam.tile_idx < 512) {
-            continue;
+        sprite->win_oy = oam->coord_y;
+        sprite->win_ox = sign_extend9(oam->coord_x);
+        sprite->sprite_sx = sprite_size_x[(oam->size_high << 2) | oam->size_low];
+        sprite->sprite_sy = sprite_size_y[(oam->size_high << 2) | oam->size_low];
+        sprite->win_sx = sprite->sprite_sx;
+        sprite->win_sy = sprite->sprite_sy;
+
+        if (oam->affine && oam->virt_dsize) {
+            sprite->win_sx *= 2;
+            sprite->win_sy *= 2;
         }
 
-        win_oy = oam.coord_y;
-        win_ox = sign_extend9(oam.coord_x);
-        sprite_sx = sprite_size_x[(oam.size_high << 2) | oam.size_low];
-        sprite_sy = sprite_size_y[(oam.size_high << 2) | oam.size_low];
-        win_sx = sprite_sx;
-        win_sy = sprite_sy;
+        if (sprite->win_oy + sprite->win_sy >= 255) { // TODO Improve this for super large sprite
+            sprite->win_oy -= 256;
+        }
 
-        if (oam.affine && oam.virt_dsize) {
-            win_sx *= 2;
-            win_sy *= 2;
+        if (oam->affine) {
+            sprite->pa = (int16_t)ppu_oam_read16(scanline, oam->affine_data_idx * 32 + 0x6);
+            sprite->pb = (int16_t)ppu_oam_read16(scanline, oam->affine_data_idx * 32 + 0xe);
+            sprite->pc = (int16_t)ppu_oam_read16(scanline, oam->affine_data_idx * 32 + 0x16);
+            sprite->pd = (int16_t)ppu_oam_read16(scanline, oam->affine_data_idx * 32 + 0x1e);
+        } else { // Identity matrix
+            sprite->pa = 0x100;
+            sprite->pb = 0;
+            sprite->pc = 0;
+            sprite->pd = 0x100;
         }
 
-        if (win_oy + win_sy >= 255) { // TODO Improve this for super large sprite
-            win_oy -= 256;
+        line = max(sprite->win_oy, 0);
+        end = min(sprite->win_oy + sprite->win_sy, GBA_SCREEN_HEIGHT);
+        for (; line < end; ++line) {
+            gba->memory.oam_sprites_per_line[line][oam_idx / 64] |= (1ull << (oam_idx % 64));
         }
+    }
+
+    gba->memory.oam_sprites_gen = scanline->oam_gen;
+}
 
-        if (line >= win_oy && line < win_oy + win_sy) {
+/*
+** Pre-render all visible sprites.
+*/
+void
+ppu_prerender_oam(
+    struct gba *gba,
+    struct scanline *scanline,
+    int32_t line
+) {
+    uint32_t bg_mode;
+    struct io const *io;
+    int32_t i;
+
+    io = &scanline->io;
+    bg_mode = io->dispcnt.bg_mode;
+
+    if (!io->dispcnt.obj) {
+        return ;
+    }
+
+    if (gba->memory.oam_sprites_gen != scanline->oam_gen) {
+        ppu_decode_oam(gba, scanline);
+    }
+
+    // Lower OAM indexes have a higher priority so they are rendered last.
+    for (i = 1; i >= 0; --i) {
+        uint64_t mask;
+
+        mask = gba->memory.oam_sprites_per_line[line][i];
+        while (mask) {
+            struct sprite const *sprite;
+            union oam_entry oam;
+            int32_t x;
+            int32_t bit;
+
+            int32_t win_oy;
+            int32_t win_ox;
+            int32_t win_sx;
+            int32_t win_sy;
+            int32_t sprite_sx;
+            int32_t sprite_sy;
             int32_t px;
             int32_t py;
             int16_t pa;
@@ -93,18 +283,35 @@ ppu_prerender_oam(
             int16_t pc;
             int16_t pd;
 
-            if (oam.affine) {
-                pa = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x6);
-                pb = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0xe);
-                pc = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x16);
-                pd = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x1e);
-            } else { // Identity matrix
-                pa = 0x100;
-                pb = 0;
-                pc = 0;
-                pd = 0x100;
+            bit = 63 - __builtin_clzll(mask);
+            mask &= ~(1ull << bit);
+
+            sprite = &gba->memory.oam_sprites[i * 64 + bit];
+            oam = sprite->oam;
+
+            // Skip OAM entries of index < 512 for BG mode 3-5
+            if (bg_mode >= 3 && bg_mode <= 5 && oam.tile_idx < 512) {
+                continue;
             }
 
+            win_oy = sprite->win_oy;
+            win_ox = sprite->win_ox;
+            win_sx = sprite->win_sx;
+            win_sy = sprite->win_sy;
+            sprite_sx = sprite->sprite_sx;
+            sprite_sy = sprite->sprite_sy;
+            pa = sprite->pa;
+            pb = sprite->pb;
+            pc = sprite->pc;
+            pd = sprite->pd;
+
+            if (!oam.affine) {
+                ppu_render_regular_sprite(gba, scanline, sprite, line);
+                continue;
+            }
+
+            // Affine sprites can't be flipped, and their mosaic depends on the transformation.
+
             /*
             ** We pre-compute PX and PY for x=0 and simply add the difference when X is increased.
             */
@@ -148,18 +355,6 @@ ppu_prerender_oam(
                     continue;
                 }
 
-                // Flip horizontally
-                if (!oam.affine && oam.hflip) {
-                    tile_x = (sprite_sx / 8) - 1 - tile_x;
-                    chr_x ^= 0b111;
-                }
-
-                // Flip vertically
-                if (!oam.affine && oam.vflip) {
-                    tile_y = (sprite_sy / 8) - 1 - tile_y;
-                    chr_y ^= 0b111;
-                }
-
                 tile_size = oam.color_256 ? 64 : 32;
                 tile_offset = 0x10000 + oam.tile_idx * 32;
 
@@ -172,36 +367,10 @@ ppu_prerender_oam(
                 if (oam.color_256) { // 256 colors, 1 palette
                     palette_idx = mem_vram_read8(gba, tile_offset + chr_y * 8 + chr_x);
                 } else { // 16 colors, 16 palettes
-
-                    /*
-                    ** In this mode, each byte represents two pixels:
-                    **   * The lower 4 bits define the color for the left pixel
-                    **   * The upper 4 bits define the color for the right pixel
-                    */
-
-                    palette_idx = mem_vram_read8(gba, tile_offset + chr_y * 4 + (chr_x >> 1));
-                    palette_idx >>= (chr_x % 2) * 4;
-                    palette_idx &= 0xF;
+                    palette_idx = ppu_tile4_pixels(gba, mem_vram_offset(tile_offset))[chr_y * 8 + chr_x];
                 }
 
-                if (palette_idx) {
-                    if (oam.mode == OAM_MODE_WINDOW) {
-                        scanline->win_obj_mask[win_ox + x] = true;
-                    } else {
-                        struct rich_color c;
-
-                        // 16-bits palette mode
-                        if (!oam.color_256) {
-                            palette_idx += oam.palette_num * 16;
-                        }
-
-                        c.raw = mem_palram_read16(gba, 0x200 + palette_idx * sizeof(union color));
-                        c.visible = true;
-                        c.idx = 4;
-                        c.force_blend = (oam.mode == OAM_MODE_BLEND);
-                        scanline->oam[oam.priority][win_ox + x] = c;
-                    }
-                }
+                ppu_draw_sprite_pixel(gba, scanline, oam, win_ox + x, palette_idx);
             }
         }
     }
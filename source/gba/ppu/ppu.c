@@ -7,15 +7,38 @@
 **
 \******************************************************************************/
 
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
+#include <sched.h>
 #include "gba/gba.h"
 #include "gba/ppu.h"
 
 static void ppu_merge_layer(struct gba const *gba, struct scanline *scanline, struct rich_color *layer);
 
+/*
+** BGR555 to RGBA conversion tables, without (index 0) and with (index 1) color correction.
+*/
+static uint32_t ppu_color_lut[2][0x8000];
+
+/*
+** A scanline queued for the render thread.
+*/
+struct ppu_render_job {
+    struct scanline scanline;
+
+    // The blocks of VRAM the scanline reads.
+    uint64_t vram_blocks;
+
+    // Copies of PALRAM and OAM, so the emulation can keep writing to them while the scanline is queued.
+    uint8_t palram[PALRAM_SIZE];
+    uint8_t oam[OAM_SIZE];
+};
+
 /*
 ** Initialize the content of the given `scanline` to a default, sane and working value.
+**
+** The inputs of the scanline must have been captured beforehand, see `ppu_capture_scanline()`.
 */
 static
 void
@@ -26,11 +49,11 @@ ppu_initialize_scanline(
     struct rich_color backdrop;
     uint32_t x;
 
-    memset(scanline, 0x00, sizeof(*scanline));
+    memset(scanline->bot, 0x00, sizeof(*scanline) - offsetof(struct scanline, bot));
 
     backdrop.visible = true;
     backdrop.idx = 5;
-    backdrop.raw = (gba->io.dispcnt.blank ? 0x7fff : mem_palram_read16(gba, PALRAM_START));
+    backdrop.raw = (scanline->io.dispcnt.blank ? 0x7fff : ppu_palram_read16(scanline, PALRAM_START));
 
     for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
         scanline->result[x] = backdrop;
@@ -41,7 +64,7 @@ ppu_initialize_scanline(
     ** it here instead (if that's useful).
     */
 
-    if (gba->io.bldcnt.mode == BLEND_LIGHT || gba->io.bldcnt.mode == BLEND_DARK) {
+    if (scanline->io.bldcnt.mode == BLEND_LIGHT || scanline->io.bldcnt.mode == BLEND_DARK) {
         scanline->top_idx = 5;
         memcpy(scanline->bg, scanline->result, sizeof(scanline->bg));
         memcpy(scanline->bot, scanline->result, sizeof(scanline->bot));
@@ -66,7 +89,7 @@ ppu_merge_layer(
     struct io const *io;
     uint32_t x;
 
-    io = &gba->io;
+    io = &scanline->io;
     eva = min(16, io->bldalpha.top_coef);
     evb = min(16, io->bldalpha.bot_coef);
     evy = min(16, io->bldy.coef);
@@ -85,14 +108,14 @@ ppu_merge_layer(
             continue;
         }
 
-        mode = gba->io.bldcnt.mode;
+        mode = io->bldcnt.mode;
         bot_enabled = bitfield_get(io->bldcnt.raw, botc.idx + 8);
 
         /* Apply windowing, if any */
         if (scanline->top_idx <= 4 && (io->dispcnt.win0 || io->dispcnt.win1 || io->dispcnt.winobj)) {
             uint8_t win_opts;
 
-            win_opts = ppu_find_top_window(gba, scanline, x);
+            win_opts = scanline->win_opts[x];
 
             /* Hide pixels that belong to a layer that this window doesn't show. */
             if (!bitfield_get(win_opts, scanline->top_idx)) {
@@ -166,7 +189,7 @@ ppu_merge_layer(
 }
 
 /*
-** Render the current scanline and write the result in `gba->framebuffer`.
+** Render the current scanline and write the result in the back framebuffer.
 */
 static
 void
@@ -178,8 +201,8 @@ ppu_render_scanline(
     int32_t prio;
     uint32_t y;
 
-    io = &gba->io;
-    y = gba->io.vcount.raw;
+    io = &scanline->io;
+    y = scanline->y;
 
     switch (io->dispcnt.bg_mode) {
         case 0: {
@@ -281,58 +304,321 @@ ppu_draw_scanline(
     struct gba *gba,
     struct scanline const *scanline
 ) {
+    uint32_t const *lut;
+    uint32_t *out;
     uint32_t x;
-    uint32_t y;
 
-    y = gba->io.vcount.raw;
+    lut = ppu_color_lut[gba->color_correction];
+    out = gba->framebuffers[gba->framebuffer_back] + GBA_SCREEN_WIDTH * scanline->y;
     for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-        struct rich_color c;
+        out[x] = lut[scanline->result[x].raw & 0x7FFF];
+    }
+}
 
-        c = scanline->result[x];
-        gba->framebuffer[GBA_SCREEN_WIDTH * y + x] = 0xFF000000
-            | (((uint32_t)c.red   << 3 ) | (((uint32_t)c.red   >> 2) & 0b111)) << 0
-            | (((uint32_t)c.green << 3 ) | (((uint32_t)c.green >> 2) & 0b111)) << 8
-            | (((uint32_t)c.blue  << 3 ) | (((uint32_t)c.blue  >> 2) & 0b111)) << 16
-        ;
+/*
+** Capture the inputs of the current scanline.
+*/
+static
+void
+ppu_capture_scanline(
+    struct gba const *gba,
+    struct scanline *scanline
+) {
+    scanline->io = gba->io;
+    scanline->y = gba->io.vcount.raw;
+    scanline->internal_px[0] = gba->ppu.internal_px[0];
+    scanline->internal_px[1] = gba->ppu.internal_px[1];
+    scanline->internal_py[0] = gba->ppu.internal_py[0];
+    scanline->internal_py[1] = gba->ppu.internal_py[1];
+    scanline->palram_data = gba->memory.palram;
+    scanline->oam_data = gba->memory.oam;
+    scanline->oam_gen = gba->memory.oam_gen;
+}
+
+static_assert(VRAM_GEN_BLOCK_COUNT <= 64);
+static_assert(64 * VRAM_TILE4_SIZE == VRAM_GEN_BLOCK_SIZE);
+
+/*
+** Return the bitmask of the blocks of VRAM covering the `size` bytes starting at offset `start`.
+**
+** Anything read past the end of VRAM is mirrored within its OBJ part, which is then covered up to the end.
+*/
+static
+uint64_t
+ppu_vram_blocks(
+    uint32_t start,
+    uint32_t size
+) {
+    uint32_t first;
+    uint32_t last;
+
+    first = start / VRAM_GEN_BLOCK_SIZE;
+    last = (min(start + size, VRAM_SIZE) - 1) / VRAM_GEN_BLOCK_SIZE;
+    return ((UINT64_MAX >> (63 - last)) & (UINT64_MAX << first));
+}
+
+/*
+** Compute the blocks of VRAM and the banks of PALRAM the rendering of the current scanline may read.
+**
+** This only depends on the IO registers, which are already part of the scanline's inputs.
+*/
+static
+void
+ppu_scanline_footprint(
+    struct io const *io,
+    uint64_t *vram_blocks,
+    uint32_t *palram_banks
+) {
+    uint32_t bg_idx;
+    uint32_t mode;
+
+    mode = io->dispcnt.bg_mode;
+
+    // The backdrop color is always read.
+    *vram_blocks = 0;
+    *palram_banks = 0b1;
+
+    switch (mode) {
+        case 0 ... 2: {
+            for (bg_idx = 0; bg_idx < 4; ++bg_idx) {
+                uint32_t screen_addr;
+                uint32_t chrs_addr;
+                uint32_t size;
+
+                if (!bitfield_get((uint8_t)io->dispcnt.bg, bg_idx)) {
+                    continue;
+                }
+
+                screen_addr = (uint32_t)io->bgcnt[bg_idx].screen_base * 0x800;
+                chrs_addr = (uint32_t)io->bgcnt[bg_idx].character_base * 0x4000;
+                size = io->bgcnt[bg_idx].size;
+
+                if (mode == 0 || (mode == 1 && bg_idx < 2)) {
+                    *vram_blocks |= ppu_vram_blocks(screen_addr, 0x800 << ((size & 0b1) + (size >> 1)));
+                    *vram_blocks |= ppu_vram_blocks(chrs_addr, 1024 * (io->bgcnt[bg_idx].palette_type ? 64 : 32));
+                } else if ((mode == 1 && bg_idx == 2) || (mode == 2 && bg_idx >= 2)) {
+                    *vram_blocks |= ppu_vram_blocks(screen_addr, 256 << (2 * size));
+                    *vram_blocks |= ppu_vram_blocks(chrs_addr, 256 * 64);
+                } else {
+                    continue;
+                }
+
+                // The palette banks of 4bpp tiles depend on the tile map, so all of them are considered.
+                *palram_banks |= 0x0000FFFF;
+            }
+            break;
+        };
+        case 3: {
+            if (bitfield_get((uint8_t)io->dispcnt.bg, 2)) {
+                *vram_blocks |= ppu_vram_blocks(0, GBA_SCREEN_WIDTH * GBA_SCREEN_HEIGHT * sizeof(union color));
+            }
+            break;
+        };
+        case 4: {
+            if (bitfield_get((uint8_t)io->dispcnt.bg, 2)) {
+                *vram_blocks |= ppu_vram_blocks(0xA000 * io->dispcnt.frame, GBA_SCREEN_WIDTH * GBA_SCREEN_HEIGHT);
+                *palram_banks |= 0x0000FFFF;
+            }
+            break;
+        };
+        case 5: {
+            if (bitfield_get((uint8_t)io->dispcnt.bg, 2)) {
+                *vram_blocks |= ppu_vram_blocks(0xA000 * io->dispcnt.frame, 160 * 128 * sizeof(union color));
+            }
+            break;
+        };
+    }
+
+    // In bitmap modes, the first half of OBJ VRAM is used by the background.
+    if (io->dispcnt.obj) {
+        *vram_blocks |= ppu_vram_blocks(mode >= 3 ? 0x14000 : 0x10000, VRAM_SIZE);
+        *palram_banks |= 0xFFFF0000;
     }
 }
 
 /*
-** Compose the content of the framebuffer based on the content of `scanline->result` and/or the backdrop color.
-** This algorithm applies a color correction.
+** Compare the inputs of the current scanline with the ones of the scanline previously rendered at the
+** same position, and store them.
 **
-** NOTE: lcd_gamma is 4.0, out_gamma is 2.0.
-** Reference:
-**   - https://near.sh/articles/video/color-emulation
+** Return `true` if they differ and the scanline must be rendered again. In both cases, `vram_blocks`
+** is set to the blocks of VRAM the scanline reads.
+*/
+static
+bool
+ppu_update_scanline_inputs(
+    struct gba *gba,
+    uint64_t *vram_blocks
+) {
+    struct scanline_inputs inputs;
+    struct scanline_inputs *old;
+    uint32_t palram_banks;
+    size_t i;
+
+    old = &gba->scanlines_inputs[gba->framebuffer_back][gba->io.vcount.raw];
+
+    // Zero the padding too, so the structures can be compared with `memcmp()`.
+    memset(&inputs, 0, sizeof(inputs));
+
+    inputs.valid = true;
+    inputs.color_correction = gba->color_correction;
+    inputs.dispcnt = gba->io.dispcnt.raw;
+    memcpy(inputs.io, &gba->io.bgcnt, sizeof(inputs.io));
+    inputs.internal_px[0] = gba->ppu.internal_px[0];
+    inputs.internal_px[1] = gba->ppu.internal_px[1];
+    inputs.internal_py[0] = gba->ppu.internal_py[0];
+    inputs.internal_py[1] = gba->ppu.internal_py[1];
+
+    /*
+    ** The set of blocks and banks the scanline reads only depends on the IO registers compared above,
+    ** so if any of them was modified since, the highest generation of that set changed too.
+    */
+    ppu_scanline_footprint(&gba->io, vram_blocks, &palram_banks);
+
+    for (i = 0; i < array_length(gba->memory.vram_gen); ++i) {
+        if ((*vram_blocks >> i) & 0b1) {
+            inputs.vram_gen = max(inputs.vram_gen, gba->memory.vram_gen[i]);
+        }
+    }
+
+    for (i = 0; i < array_length(gba->memory.palram_gen); ++i) {
+        if ((palram_banks >> i) & 0b1) {
+            inputs.palram_gen = max(inputs.palram_gen, gba->memory.palram_gen[i]);
+        }
+    }
+
+    // OAM doesn't matter if sprites are disabled.
+    inputs.oam_gen = gba->io.dispcnt.obj ? gba->memory.oam_gen : 0;
+
+    if (!memcmp(&inputs, old, sizeof(inputs))) {
+        return (false);
+    }
+
+    *old = inputs;
+    return (true);
+}
+
+/*
+** Render the given scanline, which inputs were previously captured, and write the result in the back framebuffer.
 */
 static
 void
-ppu_draw_scanline_color_correction(
+ppu_render_line(
     struct gba *gba,
-    struct scanline const *scanline
+    struct scanline *scanline
 ) {
-    uint32_t x;
-    uint32_t y;
+    ppu_initialize_scanline(gba, scanline);
 
-    y = gba->io.vcount.raw;
-    for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-        struct rich_color c;
-        float r;
-        float g;
-        float b;
+    if (!scanline->io.dispcnt.blank) {
+        if (scanline->io.mosaic.raw != gba->mosaic.raw) {
+            ppu_update_mosaic(gba, &scanline->io);
+        }
 
-        c = scanline->result[x];
+        ppu_prerender_oam(gba, scanline, scanline->y);
+        ppu_window_build_masks(gba, scanline, scanline->y);
+        ppu_render_scanline(gba, scanline);
+    }
 
-        r = c.red * c.red * c.red * c.red           / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.red   / 31.0, lcd_gamma);
-        g = c.green * c.green * c.green * c.green   / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.green / 31.0, lcd_gamma);
-        b = c.blue * c.blue * c.blue * c.blue       / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.blue  / 31.0, lcd_gamma);
+    ppu_draw_scanline(gba, scanline);
+}
 
-        gba->framebuffer[GBA_SCREEN_WIDTH * y + x] = 0xFF000000
-            | (uint32_t)(sqrt(            0.196 * g + 1.000 * r) * 213.0) << 0      // <=> pow(r, 1.0 / out_gamma);
-            | (uint32_t)(sqrt(0.118 * b + 0.902 * g + 0.039 * r) * 240.0) << 8      // <=> pow(g, 1.0 / out_gamma);
-            | (uint32_t)(sqrt(0.863 * b + 0.039 * g + 0.196 * r) * 232.0) << 16     // <=> pow(b, 1.0 / out_gamma);
-        ;
+/*
+** Capture the inputs of the current scanline, along with a copy of PALRAM and OAM, and queue it for the render thread.
+*/
+static
+void
+ppu_queue_scanline(
+    struct gba *gba,
+    uint64_t vram_blocks
+) {
+    struct ppu_render_thread *render_thread;
+    struct ppu_render_job *job;
+    uint32_t write_idx;
+
+    render_thread = &gba->render_thread;
+    write_idx = atomic_load_explicit(&render_thread->write_idx, memory_order_relaxed);
+
+    // Wait for the oldest scanline to be done if the queue is full.
+    if (write_idx - atomic_load_explicit(&render_thread->read_idx, memory_order_acquire) >= PPU_RENDER_QUEUE_SIZE) {
+        ppu_render_thread_wait(gba, write_idx - PPU_RENDER_QUEUE_SIZE + 1);
+    }
+
+    job = &render_thread->jobs[write_idx % PPU_RENDER_QUEUE_SIZE];
+    ppu_capture_scanline(gba, &job->scanline);
+
+    memcpy(job->palram, gba->memory.palram, sizeof(job->palram));
+    job->scanline.palram_data = job->palram;
+
+    // OAM isn't read if sprites are disabled.
+    if (gba->io.dispcnt.obj) {
+        memcpy(job->oam, gba->memory.oam, sizeof(job->oam));
+    }
+    job->scanline.oam_data = job->oam;
+
+    job->vram_blocks = vram_blocks;
+    render_thread->vram_blocks |= vram_blocks;
+
+    atomic_store_explicit(&render_thread->write_idx, write_idx + 1, memory_order_seq_cst);
+
+    // Wake the render thread up if it went to sleep while waiting for this scanline.
+    if (atomic_load_explicit(&render_thread->sleeping, memory_order_seq_cst)) {
+        pthread_mutex_lock(&render_thread->lock);
+        pthread_cond_signal(&render_thread->ready);
+        pthread_mutex_unlock(&render_thread->lock);
+    }
+}
+
+/*
+** Publish the framebuffer the PPU just finished and take the one that isn't used by the frontend instead.
+*/
+static
+void
+ppu_publish_framebuffer(
+    struct gba *gba
+) {
+    uint32_t old;
+
+    ++gba->framebuffer_seq;
+    old = atomic_exchange_explicit(
+        &gba->framebuffer_ready,
+        (gba->framebuffer_seq << 2) | gba->framebuffer_back,
+        memory_order_acq_rel
+    );
+    gba->framebuffer_back = old & 0b11;
+
+    if (gba->frame_callback) {
+        gba->frame_callback(gba->frame_callback_arg);
+    }
+}
+
+/*
+** Decide, according to the frame skip policy, if the frame that is about to start should be rendered.
+*/
+static
+void
+ppu_update_frame_skip(
+    struct gba *gba
+) {
+    bool skip;
+
+    if (gba->frame_skip == FRAME_SKIP_AUTO) {
+        if (gba->speed) {
+            // Render one frame out of `speed`, that's as many as the display can show.
+            skip = gba->skipped_frames + 1 < gba->speed;
+        } else {
+            /*
+            ** When the speed is unbounded, render a frame every time the frontend picked up the previous one,
+            ** and one frame out of `FRAME_SKIP_AUTO_MAX + 1` if there's no frontend asking for them.
+            */
+            skip = !atomic_exchange_explicit(&gba->frame_requested, false, memory_order_relaxed)
+                && gba->skipped_frames < FRAME_SKIP_AUTO_MAX
+            ;
+        }
+    } else {
+        skip = gba->skipped_frames < (uint32_t)max(gba->frame_skip, 0);
     }
+
+    gba->skip_frame = skip;
+    gba->skipped_frames = skip ? gba->skipped_frames + 1 : 0;
 }
 
 /*
@@ -355,16 +641,15 @@ ppu_hdraw(
     if (io->vcount.raw >= GBA_SCREEN_REAL_HEIGHT) {
         io->vcount.raw = 0;
         ++gba->framecounter;
-    } else if (io->vcount.raw == GBA_SCREEN_HEIGHT) {
+        ppu_update_frame_skip(gba);
+    } else if (io->vcount.raw == GBA_SCREEN_HEIGHT && !gba->skip_frame) {
         /*
-        ** Now that the frame is finished, we can copy the current framebuffer to
-        ** the one the frontend uses.
+        ** Now that the frame is finished, we can hand it over to the frontend.
         **
         ** Doing it now will avoid tearing.
         */
-        pthread_mutex_lock(&gba->framebuffer_frontend_mutex);
-        memcpy(gba->framebuffer_frontend, gba->framebuffer, sizeof(gba->framebuffer));
-        pthread_mutex_unlock(&gba->framebuffer_frontend_mutex);
+        ppu_render_sync(gba);
+        ppu_publish_framebuffer(gba);
     }
 
     io->dispstat.vcount_eq = (io->vcount.raw == io->dispstat.vcount_val);
@@ -407,21 +692,21 @@ ppu_hblank(
 
     io = &gba->io;
 
-    if (io->vcount.raw < GBA_SCREEN_HEIGHT) {
-        struct scanline scanline;
-
-        ppu_initialize_scanline(gba, &scanline);
-
-        if (!gba->io.dispcnt.blank) {
-            ppu_window_build_masks(gba, io->vcount.raw);
-            ppu_prerender_oam(gba, &scanline, io->vcount.raw);
-            ppu_render_scanline(gba, &scanline);
-        }
+    // The affine registers must be stepped even if the frame isn't rendered.
+    if (io->vcount.raw < GBA_SCREEN_HEIGHT && gba->skip_frame) {
+        ppu_step_affine_internal_registers(gba);
+    } else if (io->vcount.raw < GBA_SCREEN_HEIGHT) {
+        uint64_t vram_blocks;
 
-        if (gba->color_correction) {
-            ppu_draw_scanline_color_correction(gba, &scanline);
+        if (!ppu_update_scanline_inputs(gba, &vram_blocks)) {
+            // The scanline is identical to the one already in the framebuffer.
+        } else if (gba->render_thread.enabled) {
+            ppu_queue_scanline(gba, vram_blocks);
         } else {
-            ppu_draw_scanline(gba, &scanline);
+            struct scanline scanline;
+
+            ppu_capture_scanline(gba, &scanline);
+            ppu_render_line(gba, &scanline);
         }
 
         ppu_step_affine_internal_registers(gba);
@@ -446,6 +731,45 @@ ppu_hblank(
     }
 }
 
+/*
+** Build the BGR555 to RGBA conversion tables used when drawing a scanline.
+**
+** Color correction follows the algorithm described below, with an lcd_gamma of 4.0
+** and an out_gamma of 2.0.
+** Reference:
+**   - https://near.sh/articles/video/color-emulation
+*/
+void
+ppu_build_color_luts(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < array_length(ppu_color_lut[0]); ++i) {
+        union color c;
+        float r;
+        float g;
+        float b;
+
+        c.raw = i;
+
+        ppu_color_lut[0][i] = 0xFF000000
+            | (((uint32_t)c.red   << 3 ) | (((uint32_t)c.red   >> 2) & 0b111)) << 0
+            | (((uint32_t)c.green << 3 ) | (((uint32_t)c.green >> 2) & 0b111)) << 8
+            | (((uint32_t)c.blue  << 3 ) | (((uint32_t)c.blue  >> 2) & 0b111)) << 16
+        ;
+
+        r = c.red * c.red * c.red * c.red           / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.red   / 31.0, lcd_gamma);
+        g = c.green * c.green * c.green * c.green   / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.green / 31.0, lcd_gamma);
+        b = c.blue * c.blue * c.blue * c.blue       / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.blue  / 31.0, lcd_gamma);
+
+        ppu_color_lut[1][i] = 0xFF000000
+            | (uint32_t)(sqrt(            0.196 * g + 1.000 * r) * 213.0) << 0      // <=> pow(r, 1.0 / out_gamma);
+            | (uint32_t)(sqrt(0.118 * b + 0.902 * g + 0.039 * r) * 240.0) << 8      // <=> pow(g, 1.0 / out_gamma);
+            | (uint32_t)(sqrt(0.863 * b + 0.039 * g + 0.196 * r) * 232.0) << 16     // <=> pow(b, 1.0 / out_gamma);
+        ;
+    }
+}
+
 /*
 ** Initialize the PPU.
 */
@@ -453,6 +777,8 @@ void
 ppu_init(
     struct gba *gba
 ) {
+    ppu_update_mosaic(gba, &gba->io);
+
     // HDraw
     sched_add_event(
         gba,
@@ -474,6 +800,241 @@ ppu_init(
     );
 }
 
+/*
+** Entry point of the render thread.
+*/
+static
+void *
+ppu_render_thread_main(
+    void *arg
+) {
+    struct ppu_render_thread *render_thread;
+    struct gba *gba;
+    uint32_t read_idx;
+
+    gba = arg;
+    render_thread = &gba->render_thread;
+    read_idx = atomic_load_explicit(&render_thread->read_idx, memory_order_relaxed);
+
+    while (true) {
+        uint32_t spins;
+
+        // Spin for a little while before going to sleep, the next scanline is usually queued shortly after.
+        spins = 0;
+        while (atomic_load_explicit(&render_thread->write_idx, memory_order_acquire) == read_idx && spins < PPU_RENDER_SPIN_COUNT) {
+            hs_pause();
+            ++spins;
+        }
+
+        if (spins == PPU_RENDER_SPIN_COUNT) {
+            bool exit;
+
+            pthread_mutex_lock(&render_thread->lock);
+            atomic_store_explicit(&render_thread->sleeping, true, memory_order_seq_cst);
+            while (atomic_load_explicit(&render_thread->write_idx, memory_order_seq_cst) == read_idx && !render_thread->exit) {
+                pthread_cond_wait(&render_thread->ready, &render_thread->lock);
+            }
+            atomic_store_explicit(&render_thread->sleeping, false, memory_order_relaxed);
+            exit = render_thread->exit;
+            pthread_mutex_unlock(&render_thread->lock);
+
+            if (exit) {
+                break;
+            }
+        }
+
+        ppu_render_line(gba, &render_thread->jobs[read_idx % PPU_RENDER_QUEUE_SIZE].scanline);
+        ++read_idx;
+        atomic_store_explicit(&render_thread->read_idx, read_idx, memory_order_release);
+    }
+
+    return (NULL);
+}
+
+/*
+** Wait for the render thread to be done with all the scanlines queued before the one of index `idx`.
+**
+** Prefer `ppu_render_sync()` to wait for all of them, which only calls this function if the queue isn't empty.
+*/
+void
+ppu_render_thread_wait(
+    struct gba *gba,
+    uint32_t idx
+) {
+    struct ppu_render_thread *render_thread;
+    uint32_t spins;
+
+    render_thread = &gba->render_thread;
+
+    // Spin for a little while, the render thread is usually about to be done, and give up the CPU if it isn't.
+    spins = 0;
+    while ((int32_t)(idx - atomic_load_explicit(&render_thread->read_idx, memory_order_acquire)) > 0) {
+        if (spins < PPU_RENDER_SPIN_COUNT) {
+            hs_pause();
+            ++spins;
+        } else {
+            sched_yield();
+        }
+    }
+
+    if (idx == atomic_load_explicit(&render_thread->write_idx, memory_order_relaxed)) {
+        render_thread->vram_blocks = 0;
+    }
+}
+
+/*
+** Wait for the queued scanlines reading the given block of VRAM to be rendered, and narrow
+** `render_thread.vram_blocks` down to the blocks read by the remaining ones.
+**
+** Prefer `ppu_render_sync_vram()` which only calls this function if one of them may read that block.
+*/
+void
+ppu_render_thread_wait_vram(
+    struct gba *gba,
+    uint32_t block
+) {
+    struct ppu_render_thread *render_thread;
+    uint64_t vram_blocks;
+    uint32_t read_idx;
+    uint32_t idx;
+
+    render_thread = &gba->render_thread;
+    read_idx = atomic_load_explicit(&render_thread->read_idx, memory_order_acquire);
+    idx = atomic_load_explicit(&render_thread->write_idx, memory_order_relaxed);
+    vram_blocks = 0;
+
+    // Walk the queue backward, up to the most recent scanline reading that block.
+    while (idx != read_idx) {
+        struct ppu_render_job const *job;
+
+        job = &render_thread->jobs[(idx - 1) % PPU_RENDER_QUEUE_SIZE];
+        if (job->vram_blocks & (1ull << block)) {
+            ppu_render_thread_wait(gba, idx);
+            break;
+        }
+
+        vram_blocks |= job->vram_blocks;
+        --idx;
+    }
+
+    render_thread->vram_blocks = vram_blocks;
+}
+
+/*
+** Enable or disable rendering the scanlines on a separate thread.
+*/
+void
+ppu_set_threaded_rendering(
+    struct gba *gba,
+    bool enable
+) {
+    struct ppu_render_thread *render_thread;
+
+    render_thread = &gba->render_thread;
+
+    if (render_thread->enabled == enable) {
+        return ;
+    }
+
+    if (enable) {
+        render_thread->jobs = calloc(PPU_RENDER_QUEUE_SIZE, sizeof(struct ppu_render_job));
+        hs_assert(render_thread->jobs);
+
+        pthread_mutex_init(&render_thread->lock, NULL);
+        pthread_cond_init(&render_thread->ready, NULL);
+        render_thread->exit = false;
+        render_thread->vram_blocks = 0;
+        atomic_store(&render_thread->sleeping, false);
+        atomic_store(&render_thread->write_idx, 0);
+        atomic_store(&render_thread->read_idx, 0);
+
+        if (pthread_create(&render_thread->thread, NULL, ppu_render_thread_main, gba)) {
+            logln(HS_WARNING, "Failed to create the render thread, scanlines will be rendered on the emulation thread.");
+            pthread_cond_destroy(&render_thread->ready);
+            pthread_mutex_destroy(&render_thread->lock);
+            free(render_thread->jobs);
+            render_thread->jobs = NULL;
+            return ;
+        }
+    } else {
+        ppu_render_sync(gba);
+
+        pthread_mutex_lock(&render_thread->lock);
+        render_thread->exit = true;
+        pthread_cond_signal(&render_thread->ready);
+        pthread_mutex_unlock(&render_thread->lock);
+
+        pthread_join(render_thread->thread, NULL);
+        pthread_cond_destroy(&render_thread->ready);
+        pthread_mutex_destroy(&render_thread->lock);
+        free(render_thread->jobs);
+        render_thread->jobs = NULL;
+    }
+
+    render_thread->enabled = enable;
+}
+
+/*
+** Rebuild the mosaic lookup tables according to the content of REG_MOSAIC in `io`.
+**
+** This is done by whichever thread renders the scanlines, so the emulation must call `ppu_render_sync()`
+** before calling this function itself.
+*/
+void
+ppu_update_mosaic(
+    struct gba *gba,
+    struct io const *io
+) {
+    uint32_t bg_vsize;
+    uint32_t obj_hsize;
+    uint32_t obj_vsize;
+    uint32_t i;
+
+    bg_vsize = io->mosaic.bg_vsize + 1;
+    obj_hsize = io->mosaic.obj_hsize + 1;
+    obj_vsize = io->mosaic.obj_vsize + 1;
+
+    for (i = 0; i < GBA_SCREEN_WIDTH; ++i) {
+        gba->mosaic.obj_x[i] = i / obj_hsize * obj_hsize;
+    }
+
+    for (i = 0; i < GBA_SCREEN_HEIGHT; ++i) {
+        gba->mosaic.bg_y[i] = i / bg_vsize * bg_vsize;
+        gba->mosaic.obj_y[i] = i / obj_vsize * obj_vsize;
+    }
+
+    gba->mosaic.raw = io->mosaic.raw;
+}
+
+/*
+** Expand the 4bpp tile of given index to one byte per pixel and store the result in `memory.vram_tiles`.
+*/
+uint8_t const *
+ppu_decode_tile4(
+    struct gba *gba,
+    uint32_t tile_idx
+) {
+    uint8_t const *src;
+    uint8_t *dst;
+    uint32_t i;
+
+    src = gba->memory.vram + tile_idx * VRAM_TILE4_SIZE;
+    dst = gba->memory.vram_tiles[tile_idx];
+
+    /*
+    ** Each byte represents two pixels:
+    **   * The lower 4 bits define the color of the left pixel
+    **   * The upper 4 bits define the color of the right pixel
+    */
+    for (i = 0; i < VRAM_TILE4_SIZE; ++i) {
+        dst[i * 2 + 0] = src[i] & 0xF;
+        dst[i * 2 + 1] = src[i] >> 4;
+    }
+
+    gba->memory.vram_tiles_dirty[tile_idx / 64] &= ~(1ull << (tile_idx % 64));
+    return (dst);
+}
+
 /*
 ** Called when the CPU enters stop-mode to render the screen black.
 */
@@ -481,7 +1042,8 @@ void
 ppu_render_black_screen(
     struct gba *gba
 ) {
-    pthread_mutex_lock(&gba->framebuffer_frontend_mutex);
-    memset(gba->framebuffer_frontend, 0x00, sizeof(gba->framebuffer));
-    pthread_mutex_unlock(&gba->framebuffer_frontend_mutex);
+    ppu_render_sync(gba);
+    memset(gba->framebuffers[gba->framebuffer_back], 0x00, sizeof(gba->framebuffers[0]));
+    memset(gba->scanlines_inputs[gba->framebuffer_back], 0x00, sizeof(gba->scanlines_inputs[0]));
+    ppu_publish_framebuffer(gba);
 }
@@ -11,67 +11,59 @@
 #include "gba/gba.h"
 #include "gba/ppu.h"
 
+/*
+** Fill `scanline->win_opts` with the WININ/WINOUT settings of the top-most window covering each pixel.
+**
+** Windows are rectangles, so they are applied as spans, from the lowest priority one (outside of any
+** window) to the highest one (WIN0).
+**
+** This must be called after the sprites were pre-rendered, as it relies on `scanline->win_obj_mask`.
+*/
 void
 ppu_window_build_masks(
-    struct gba *gba,
+    struct gba const *gba,
+    struct scanline *scanline,
     uint32_t y
 ) {
-    uint32_t idx;
+    uint32_t x;
+    int32_t idx;
 
-    for (idx = 0; idx < 2; ++idx) {
-        uint32_t x;
+    memset(scanline->win_opts, scanline->io.winout.winout, sizeof(scanline->win_opts));
+
+    for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
+        if (scanline->win_obj_mask[x]) {
+            scanline->win_opts[x] = scanline->io.winout.winobj;
+        }
+    }
+
+    for (idx = WIN1; idx >= WIN0; --idx) {
         uint32_t minx;
         uint32_t maxx;
         uint32_t miny;
         uint32_t maxy;
-        uint32_t hash;
+        uint8_t opts;
         bool enabled;
         bool within_y;
 
-        miny = gba->io.winv[idx].min;
-        maxy = gba->io.winv[idx].max;
-        enabled = bitfield_get(gba->io.dispcnt.raw, 13 + idx);
-        minx = gba->io.winh[idx].min;
-        maxx = gba->io.winh[idx].max;
+        miny = scanline->io.winv[idx].min;
+        maxy = scanline->io.winv[idx].max;
+        enabled = bitfield_get(scanline->io.dispcnt.raw, 13 + idx);
+        minx = min(scanline->io.winh[idx].min, GBA_SCREEN_WIDTH);
+        maxx = min(scanline->io.winh[idx].max, GBA_SCREEN_WIDTH);
         within_y = !((miny <= maxy && (y < miny || y >= maxy)) || (miny > maxy  && (y >= miny || y < maxy)));
+        opts = (idx == WIN0) ? scanline->io.winin.win0 : scanline->io.winin.win1;
 
-        /* Avoid rebuilding the masks if the parameters are the same. */
-        hash = minx | (maxx << 8) | (enabled << 16) | (within_y << 17);
-        if (hash == gba->ppu.win_masks_hash[idx]) {
+        if (!enabled || !within_y) {
             continue;
         }
 
-        gba->ppu.win_masks_hash[idx] = hash;
-
-        if (!enabled || !within_y) {
-            memset(gba->ppu.win_masks[idx], 0, sizeof(gba->ppu.win_masks[WIN0]));
-        } else {
-            if (minx <= maxx) {
-                for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-                    gba->ppu.win_masks[idx][x] = (x >= minx && x < maxx);
-                }
-            } else {
-                for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-                    gba->ppu.win_masks[idx][x] = (x >= minx || x < maxx);
-                }
+        if (scanline->io.winh[idx].min <= scanline->io.winh[idx].max) {
+            if (minx < maxx) {
+                memset(scanline->win_opts + minx, opts, maxx - minx);
             }
+        } else {
+            memset(scanline->win_opts, opts, maxx);
+            memset(scanline->win_opts + minx, opts, GBA_SCREEN_WIDTH - minx);
         }
     }
 }
-
-uint8_t
-ppu_find_top_window(
-    struct gba const *gba,
-    struct scanline const *scanline,
-    uint32_t x
-) {
-    if (gba->ppu.win_masks[WIN0][x]) {
-        return (gba->io.winin.win0);
-    } else if (gba->ppu.win_masks[WIN1][x]) {
-        return (gba->io.winin.win1);
-    } else if (scanline->win_obj_mask[x]) {
-        return (gba->io.winout.winobj);
-    } else {
-        return (gba->io.winout.winout);
-    }
-}
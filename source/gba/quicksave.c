@@ -48,6 +48,9 @@ quicksave(
         || fwrite(&gba->gpio, sizeof(gba->gpio), 1, file) != 1
         || fwrite(&gba->apu.fifos, sizeof(gba->apu.fifos), 1, file) != 1
         || fwrite(&gba->apu.wave, sizeof(gba->apu.wave), 1, file) != 1
+        || fwrite(&gba->apu.psg, sizeof(gba->apu.psg), 1, file) != 1
+        || fwrite(&gba->apu.sweep, sizeof(gba->apu.sweep), 1, file) != 1
+        || fwrite(&gba->apu.sequencer_step, sizeof(gba->apu.sequencer_step), 1, file) != 1
         || fwrite(&gba->apu.latch, sizeof(gba->apu.latch), 1, file) != 1
         || fwrite(&gba->scheduler.next_event, sizeof(uint64_t), 1, file) != 1
     ) {
@@ -108,6 +111,8 @@ quickload(
     FILE *file;
     size_t i;
 
+    ppu_render_sync(gba);
+
     file = hs_fopen(path, "rb");
     if (!file) {
         goto err;
@@ -130,12 +135,19 @@ quickload(
         || fread(&gba->gpio, sizeof(gba->gpio), 1, file) != 1
         || fread(&gba->apu.fifos, sizeof(gba->apu.fifos), 1, file) != 1
         || fread(&gba->apu.wave, sizeof(gba->apu.wave), 1, file) != 1
+        || fread(&gba->apu.psg, sizeof(gba->apu.psg), 1, file) != 1
+        || fread(&gba->apu.sweep, sizeof(gba->apu.sweep), 1, file) != 1
+        || fread(&gba->apu.sequencer_step, sizeof(gba->apu.sequencer_step), 1, file) != 1
         || fread(&gba->apu.latch, sizeof(gba->apu.latch), 1, file) != 1
         || fread(&gba->scheduler.next_event, sizeof(uint64_t), 1, file) != 1
     ) {
         goto err;
     }
 
+    mem_invalidate_display_caches(&gba->memory);
+    ppu_update_mosaic(gba, &gba->io);
+    apu_mixer_reset(gba);
+
     // Serialize the scheduler's event list
     for (i = 0; i < gba->scheduler.events_size; ++i) {
         struct scheduler_event *event;
@@ -87,6 +87,14 @@ gui_config_load(
             app->emulation.rtc_force_enabled = b;
         }
 
+        if (mjson_get_bool(data, data_len, "$.emulation.realtime_priority", &b)) {
+            app->emulation.realtime_priority = b;
+        }
+
+        if (mjson_get_number(data, data_len, "$.emulation.cpu_affinity", &d)) {
+            app->emulation.cpu_affinity = max(-1, (int)d);
+        }
+
         if (mjson_get_bool(data, data_len, "$.emulation.skip_bios", &b)) {
             app->emulation.skip_bios = b;
         }
@@ -111,10 +119,23 @@ gui_config_load(
             app->video.vsync = b;
         }
 
+        if (mjson_get_bool(data, data_len, "$.video.present_deadline", &b)) {
+            app->video.present_deadline = b;
+        }
+
         if (mjson_get_bool(data, data_len, "$.video.color_correction", &b)) {
             app->video.color_correction = b;
         }
 
+        if (mjson_get_bool(data, data_len, "$.video.threaded_rendering", &b)) {
+            app->video.threaded_rendering = b;
+        }
+
+        if (mjson_get_number(data, data_len, "$.video.frame_skip", &d)) {
+            app->video.frame_skip = (int)d;
+            app->video.frame_skip = max(FRAME_SKIP_AUTO, min(app->video.frame_skip, 4));
+        }
+
         if (mjson_get_number(data, data_len, "$.video.texture_filter", &d)) {
             app->video.texture_filter.kind = (int)d;
             app->video.texture_filter.kind = max(TEXTURE_FILTER_MIN, min(app->video.texture_filter.kind, TEXTURE_FILTER_MAX));
@@ -135,6 +156,31 @@ gui_config_load(
             app->audio.level = d;
             app->audio.level = max(0.f, min(app->audio.level, 1.f));
         }
+
+        if (mjson_get_number(data, data_len, "$.audio.buffer_size", &d)) {
+            // Only powers of two are offered (and accepted by most audio devices), round down to the closest one.
+            app->audio.buffer_size = AUDIO_BUFFER_SIZE_MIN;
+            while (app->audio.buffer_size < AUDIO_BUFFER_SIZE_MAX && app->audio.buffer_size * 2 <= d) {
+                app->audio.buffer_size *= 2;
+            }
+        }
+
+        if (mjson_get_bool(data, data_len, "$.audio.audio_master", &b)) {
+            app->audio.audio_master = b;
+        }
+
+        if (mjson_get_bool(data, data_len, "$.audio.time_stretch", &b)) {
+            app->audio.time_stretch = b;
+        }
+
+        if (mjson_get_bool(data, data_len, "$.audio.record_sources", &b)) {
+            app->audio.record_sources = b;
+        }
+
+        if (mjson_get_number(data, data_len, "$.audio.record_format", &d)) {
+            app->audio.record_format = (int)d;
+            app->audio.record_format = max(APU_RECORD_WAV, min(app->audio.record_format, APU_RECORD_RAW));
+        }
     }
 
     // Binds
@@ -211,7 +257,9 @@ gui_config_save(
                 "unbounded": %B,
                 "backup_type": %d,
                 "rtc_autodetect": %B,
-                "rtc_force_enabled": %B
+                "rtc_force_enabled": %B,
+                "realtime_priority": %B,
+                "cpu_affinity": %d
             },
 
             // Video
@@ -219,14 +267,22 @@ gui_config_save(
                 "display_size": %d,
                 "aspect_ratio": %d,
                 "vsync": %B,
+                "present_deadline": %B,
                 "color_correction": %B,
+                "threaded_rendering": %B,
+                "frame_skip": %d,
                 "texture_filter": %d
             },
 
             // Audio
             "audio": {
                 "mute": %B,
-                "level": %g
+                "level": %g,
+                "buffer_size": %d,
+                "audio_master": %B,
+                "time_stretch": %B,
+                "record_sources": %B,
+                "record_format": %d
             },
         }),
         app->file.bios_path,
@@ -241,13 +297,23 @@ gui_config_save(
         (int)app->emulation.backup_type,
         (int)app->emulation.rtc_autodetect,
         (int)app->emulation.rtc_force_enabled,
+        (int)app->emulation.realtime_priority,
+        (int)app->emulation.cpu_affinity,
         (int)app->video.display_size,
         (int)app->video.aspect_ratio,
         (int)app->video.vsync,
+        (int)app->video.present_deadline,
         (int)app->video.color_correction,
+        (int)app->video.threaded_rendering,
+        (int)app->video.frame_skip,
         (int)app->video.texture_filter.kind,
         (int)app->audio.mute,
-        app->audio.level
+        app->audio.level,
+        (int)app->audio.buffer_size,
+        (int)app->audio.audio_master,
+        (int)app->audio.time_stretch,
+        (int)app->audio.record_sources,
+        (int)app->audio.record_format
     );
 
     if (!data) {
@@ -13,9 +13,11 @@
 #include "gba/gba.h"
 
 /*
-** Should be called roughly 23/24 times per second (48000 / 2048, see the the values in `gui_sdl_audio_init()`).
+** Should be called roughly 23/24 times per second with the default settings (48000 / 2048, see the values
+** in `gui_sdl_audio_init()`).
 **
 ** We transfer the data contained in the apu_rbuffer to the SDL.
+** The ring buffer is lock-free so this never blocks the emulation thread, and vice-versa.
 */
 static
 void
@@ -27,6 +29,7 @@ gui_sdl_audio_callback(
     struct app *app;
     struct gba *gba;
     int16_t *stream;
+    uint32_t *frames;
     size_t len;
     size_t i;
 
@@ -35,13 +38,19 @@ gui_sdl_audio_callback(
     stream = (int16_t *)raw_stream;
     len = raw_stream_len / (2 * sizeof(*stream));
 
-    pthread_mutex_lock(&gba->apu.frontend_channels_mutex);
+    /*
+    ** Each stereo frame is as big as one of the ring buffer's frames so we can pop them
+    ** directly in the output stream and convert them in place.
+    */
+    frames = (uint32_t *)raw_stream;
+    apu_rbuffer_pop(&gba->apu.frontend_channels, frames, len);
+
     for (i = 0; i < len; ++i) {
         uint32_t val;
         int16_t left;
         int16_t right;
 
-        val = apu_rbuffer_pop(&gba->apu.frontend_channels);
+        val = frames[i];
         left = (int16_t)((val >> 16) & 0xFFFF);
         right = (int16_t)(val & 0xFFFF);
 
@@ -49,7 +58,6 @@ gui_sdl_audio_callback(
         stream[1] = (int16_t)(right * !app->audio.mute * app->audio.level);
         stream += 2;
     }
-    pthread_mutex_unlock(&gba->apu.frontend_channels_mutex);
 }
 
 void
@@ -60,7 +68,7 @@ gui_sdl_audio_init(
     SDL_AudioSpec have;
 
     want.freq = 48000;
-    want.samples = 2048;
+    want.samples = app->audio.buffer_size;
     want.format = AUDIO_S16;
     want.channels = 2;
     want.callback = gui_sdl_audio_callback;
@@ -73,7 +81,7 @@ gui_sdl_audio_init(
         exit(EXIT_FAILURE);
     }
 
-    gba_send_audio_resample_freq(app->emulation.gba, CYCLES_PER_SECOND / have.freq);
+    gba_send_audio_resample_freq(app->emulation.gba, have.freq, have.samples);
 
     SDL_PauseAudioDevice(app->sdl.audio_device, SDL_FALSE);
 }
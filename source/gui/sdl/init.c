@@ -25,6 +25,14 @@ gui_sdl_init(
         exit(EXIT_FAILURE);
     }
 
+    /* Register the event used by the emulation thread to notify us of new frames */
+    app->sdl.frame_event = SDL_RegisterEvents(1);
+    atomic_init(&app->sdl.frame_event_pending, false);
+    if (app->sdl.frame_event != (uint32_t)-1) {
+        app->emulation.gba->frame_callback = gui_sdl_frame_callback;
+        app->emulation.gba->frame_callback_arg = app;
+    }
+
     gui_sdl_audio_init(app);
     gui_sdl_video_init(app);
 }
@@ -175,6 +175,61 @@ gui_sdl_handle_bind(
     }
 }
 
+/*
+** Called by the emulation thread each time a new frame is published, to wake the GUI up.
+**
+** Only one event is in flight at any time, the next one is pushed once the GUI handled it.
+*/
+void
+gui_sdl_frame_callback(
+    void *raw_app
+) {
+    struct app *app;
+
+    app = raw_app;
+    if (!atomic_exchange(&app->sdl.frame_event_pending, true)) {
+        SDL_Event event;
+
+        memset(&event, 0, sizeof(event));
+        event.type = app->sdl.frame_event;
+        SDL_PushEvent(&event);
+    }
+}
+
+/*
+** Block until an event is available or until `timeout` milliseconds have passed.
+**
+** The event isn't removed from the queue, `gui_sdl_handle_inputs()` takes care of it.
+*/
+void
+gui_sdl_wait_events(
+    struct app *app __unused,
+    uint32_t timeout
+) {
+    SDL_WaitEventTimeout(NULL, (int)timeout);
+}
+
+/*
+** Handle the incoming events until `SDL_GetPerformanceCounter()` reaches `deadline`.
+*/
+void
+gui_sdl_handle_inputs_until(
+    struct app *app,
+    uint64_t deadline
+) {
+    uint64_t freq;
+    uint64_t now;
+
+    freq = SDL_GetPerformanceFrequency();
+    now = SDL_GetPerformanceCounter();
+    while (now < deadline) {
+        // Round up, a timeout of 0 would turn this into a busy loop.
+        gui_sdl_wait_events(app, (uint32_t)(((deadline - now) * 1000 + freq - 1) / freq));
+        gui_sdl_handle_inputs(app);
+        now = SDL_GetPerformanceCounter();
+    }
+}
+
 void
 gui_sdl_handle_inputs(
     struct app *app
@@ -183,6 +238,11 @@ gui_sdl_handle_inputs(
 
     /* Handle all SDL events */
     while (SDL_PollEvent(&event) != 0) {
+        if (event.type == app->sdl.frame_event) {
+            atomic_store(&app->sdl.frame_event_pending, false);
+            continue;
+        }
+
         ImGui_ImplSDL2_ProcessEvent(&event);
 
         switch (event.type) {
@@ -139,8 +139,43 @@ gui_sdl_video_init(
     ImGui_ImplSDL2_InitForOpenGL(app->sdl.window, app->sdl.gl_context);
     ImGui_ImplOpenGL3_Init(glsl_version);
 
-    /* Create the OpenGL texture that will hold the game's output */
+    /*
+    ** Create the OpenGL texture that will hold the game's output.
+    **
+    ** Its storage is allocated once, and only updated afterwards.
+    */
     glGenTextures(1, &app->sdl.game_texture);
+    glBindTexture(GL_TEXTURE_2D, app->sdl.game_texture);
+    if (GLEW_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, GBA_SCREEN_WIDTH, GBA_SCREEN_HEIGHT);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, GBA_SCREEN_WIDTH, GBA_SCREEN_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    app->sdl.game_texture_seq = UINT32_MAX; // Force the upload of the first frame
+
+    /* Create the pixel buffer objects used to stream the frames to the texture, if supported */
+    memset(&app->sdl.game_pbo, 0, sizeof(app->sdl.game_pbo));
+    if (GLEW_ARB_buffer_storage && GLEW_ARB_sync) {
+        GLbitfield flags;
+        GLsizeiptr size;
+
+        flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        size = GAME_TEXTURE_PBO_COUNT * sizeof(app->emulation.gba->framebuffers[0]);
+
+        glGenBuffers(1, &app->sdl.game_pbo.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, app->sdl.game_pbo.buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+        app->sdl.game_pbo.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (app->sdl.game_pbo.mapped) {
+            app->sdl.game_pbo.enabled = true;
+        } else {
+            logln(HS_WARNING, "Failed to map the game's pixel buffer objects, falling back to direct uploads.");
+            glDeleteBuffers(1, &app->sdl.game_pbo.buffer);
+        }
+    }
 
     /* Setup the game controller stuff */
     app->sdl.controller.ptr = NULL;
@@ -164,6 +199,19 @@ gui_sdl_video_cleanup(
     igDestroyContext(NULL);
 
     // Cleanup OpenGL
+    if (app->sdl.game_pbo.enabled) {
+        size_t i;
+
+        for (i = 0; i < GAME_TEXTURE_PBO_COUNT; ++i) {
+            if (app->sdl.game_pbo.fences[i]) {
+                glDeleteSync(app->sdl.game_pbo.fences[i]);
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, app->sdl.game_pbo.buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &app->sdl.game_pbo.buffer);
+    }
     glDeleteTextures(1, &app->sdl.game_texture);
     SDL_GL_DeleteContext(app->sdl.gl_context);
 
@@ -175,6 +223,10 @@ void
 gui_sdl_video_render_frame(
     struct app *app
 ) {
+    uint64_t start;
+
+    start = SDL_GetPerformanceCounter();
+
     /* Create the new frame */
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame(app->sdl.window);
@@ -219,5 +271,44 @@ gui_sdl_video_render_frame(
         SDL_GL_MakeCurrent(backup_current_window, backup_current_context);
     }
 
+    /*
+    ** Keep track of how long rendering takes (smoothed) and when the buffers were swapped, which,
+    ** with VSync enabled, is right after a vertical blank.
+    */
+    app->ui.present.render_time = (app->ui.present.render_time * 7 + (SDL_GetPerformanceCounter() - start)) / 8;
+
     SDL_GL_SwapWindow(app->sdl.window);
+
+    app->ui.present.last_swap = SDL_GetPerformanceCounter();
+}
+
+/*
+** Handle the incoming events until it's time to render the next frame so that it's ready just before
+** the next vertical blank.
+**
+** This minimizes the time between the emulator publishing a frame, or the user pressing a key, and that
+** frame being displayed.
+*/
+void
+gui_sdl_video_wait_present_deadline(
+    struct app *app
+) {
+    uint64_t freq;
+    uint64_t period;
+    uint64_t deadline;
+    uint64_t now;
+
+    freq = SDL_GetPerformanceFrequency();
+    period = freq / max(1u, app->ui.refresh_rate);
+
+    /* Aim a millisecond before the point where rendering must start to be ready in time */
+    deadline = app->ui.present.last_swap + period - min(period, app->ui.present.render_time + freq / 1000);
+
+    /* If the swap didn't block or we are running late, aim for the next vertical blank instead */
+    now = SDL_GetPerformanceCounter();
+    if (deadline < now) {
+        deadline += ((now - deadline) / period + 1) * period;
+    }
+
+    gui_sdl_handle_inputs_until(app, deadline);
 }
@@ -10,11 +10,83 @@
 #define _GNU_SOURCE
 #define CIMGUI_DEFINE_ENUMS_AND_STRUCTS
 
+#include <string.h>
 #include <cimgui.h>
 #include "hades.h"
 #include "app.h"
 #include "gui/gui.h"
 
+/*
+** Upload the latest frame to the game's texture, which must be bound.
+**
+** Nothing is done if that frame was already uploaded.
+*/
+static
+void
+gui_win_game_upload_frame(
+    struct app *app
+) {
+    uint32_t const *frame;
+    uint32_t seq;
+
+    frame = gba_framebuffer_acquire(app->emulation.gba, &seq);
+    if (seq == app->sdl.game_texture_seq) {
+        return ;
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    if (app->sdl.game_pbo.enabled) {
+        GLsync *fence;
+        size_t offset;
+
+        /*
+        ** Wait for the GPU to be done with the slot we are about to overwrite.
+        ** With a ring of three buffers this should basically never block.
+        */
+        fence = &app->sdl.game_pbo.fences[app->sdl.game_pbo.idx];
+        if (*fence) {
+            glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+            glDeleteSync(*fence);
+            *fence = NULL;
+        }
+
+        offset = app->sdl.game_pbo.idx * sizeof(app->emulation.gba->framebuffers[0]);
+        memcpy(app->sdl.game_pbo.mapped + offset, frame, sizeof(app->emulation.gba->framebuffers[0]));
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, app->sdl.game_pbo.buffer);
+        glTexSubImage2D(
+            GL_TEXTURE_2D,
+            0,
+            0,
+            0,
+            GBA_SCREEN_WIDTH,
+            GBA_SCREEN_HEIGHT,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            (void const *)(uintptr_t)offset
+        );
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        app->sdl.game_pbo.idx = (app->sdl.game_pbo.idx + 1) % GAME_TEXTURE_PBO_COUNT;
+    } else {
+        glTexSubImage2D(
+            GL_TEXTURE_2D,
+            0,
+            0,
+            0,
+            GBA_SCREEN_WIDTH,
+            GBA_SCREEN_HEIGHT,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            (uint8_t const *)frame
+        );
+    }
+
+    app->sdl.game_texture_seq = seq;
+}
+
 void
 gui_win_game(
     struct app *app
@@ -82,10 +154,7 @@ gui_win_game(
         app->video.texture_filter.refresh = false;
     }
 
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    pthread_mutex_lock(&app->emulation.gba->framebuffer_frontend_mutex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GBA_SCREEN_WIDTH, GBA_SCREEN_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, (uint8_t *)app->emulation.gba->framebuffer_frontend);
-    pthread_mutex_unlock(&app->emulation.gba->framebuffer_frontend_mutex);
+    gui_win_game_upload_frame(app);
 
     glBindTexture(GL_TEXTURE_2D, last_texture);
 
@@ -366,12 +366,52 @@ gui_win_menubar_video(
             gba_send_settings_color_correction(app->emulation.gba, app->video.color_correction);
         }
 
+        /* Frame Skip */
+        if (igBeginMenu("Frame Skip", true)) {
+            int32_t x;
+
+            static char const * const frame_skips[] = {
+                "None",
+                "1",
+                "2",
+                "3",
+                "4",
+            };
+
+            if (igMenuItemBool("Auto", NULL, app->video.frame_skip == FRAME_SKIP_AUTO, true)) {
+                app->video.frame_skip = FRAME_SKIP_AUTO;
+                gba_send_settings_frame_skip(app->emulation.gba, app->video.frame_skip);
+            }
+
+            igSeparator();
+
+            for (x = 0; x <= 4; ++x) {
+                if (igMenuItemBool(frame_skips[x], NULL, app->video.frame_skip == x, true)) {
+                    app->video.frame_skip = x;
+                    gba_send_settings_frame_skip(app->emulation.gba, app->video.frame_skip);
+                }
+            }
+
+            igEndMenu();
+        }
+
+        /* Threaded Rendering */
+        if (igMenuItemBool("Threaded rendering", NULL, app->video.threaded_rendering, true)) {
+            app->video.threaded_rendering ^= 1;
+            gba_send_settings_threaded_rendering(app->emulation.gba, app->video.threaded_rendering);
+        }
+
         /* VSync */
         if (igMenuItemBool("VSync", NULL, app->video.vsync, true)) {
             app->video.vsync ^= 1;
             SDL_GL_SetSwapInterval(app->video.vsync);
         }
 
+        /* Presentation deadline */
+        if (igMenuItemBool("Low-latency presentation", NULL, app->video.present_deadline, app->video.vsync)) {
+            app->video.present_deadline ^= 1;
+        }
+
         igSeparator();
 
         /* Take a screenshot */
@@ -391,6 +431,7 @@ gui_win_menubar_audio(
 ) {
     if (igBeginMenu("Audio", true)) {
         float percent;
+        bool recording;
 
         /* VSync */
         if (igMenuItemBool("Mute", NULL, app->audio.mute, true)) {
@@ -410,6 +451,68 @@ gui_win_menubar_audio(
         app->audio.level = max(0.0f, min(percent / 100.f, 1.f));
 
         igSpacing();
+        igSeparator();
+
+        /* Buffer size */
+        if (igBeginMenu("Buffer Size", true)) {
+            uint32_t size;
+
+            for (size = AUDIO_BUFFER_SIZE_MIN; size <= AUDIO_BUFFER_SIZE_MAX; size *= 2) {
+                char label[16];
+
+                snprintf(label, sizeof(label), "%u", size);
+                if (igMenuItemBool(label, NULL, app->audio.buffer_size == size, true)) {
+                    app->audio.buffer_size = size;
+
+                    // Re-open the audio device with the new buffer size
+                    gui_sdl_audio_cleanup(app);
+                    gui_sdl_audio_init(app);
+                }
+            }
+
+            igEndMenu();
+        }
+
+        /* Audio master */
+        if (igMenuItemBool("Sync to audio", NULL, app->audio.audio_master, true)) {
+            app->audio.audio_master ^= 1;
+            gba_send_settings_audio_master(app->emulation.gba, app->audio.audio_master);
+        }
+
+        /* Time-stretching */
+        if (igMenuItemBool("Preserve pitch when fast-forwarding", NULL, app->audio.time_stretch, true)) {
+            app->audio.time_stretch ^= 1;
+            gba_send_settings_time_stretch(app->emulation.gba, app->audio.time_stretch);
+        }
+
+        igSeparator();
+
+        /* Audio recording */
+        recording = atomic_load_explicit(&app->emulation.gba->apu.recorder.recording, memory_order_relaxed);
+
+        if (igMenuItemBool(recording ? "Stop Recording" : "Record", NULL, false, true)) {
+            if (recording) {
+                app_game_stop_audio_recording(app);
+            } else {
+                app_game_record_audio(app);
+            }
+        }
+
+        if (igBeginMenu("Recording Format", !recording)) {
+            if (igMenuItemBool("WAV", NULL, app->audio.record_format == APU_RECORD_WAV, true)) {
+                app->audio.record_format = APU_RECORD_WAV;
+            }
+
+            if (igMenuItemBool("Raw PCM (16 bits)", NULL, app->audio.record_format == APU_RECORD_RAW, true)) {
+                app->audio.record_format = APU_RECORD_RAW;
+            }
+
+            igEndMenu();
+        }
+
+        if (igMenuItemBool("Record Each Source Separately", NULL, app->audio.record_sources, !recording)) {
+            app->audio.record_sources ^= 1;
+        }
 
         igEndMenu();
     }
@@ -485,6 +588,13 @@ gui_win_menubar_fps_counter(
 
         igSameLine(igGetWindowWidth() - (app->ui.menubar_fps_width + spacing * 2), 1);
         igText("FPS: %u (%u%%)", app->emulation.fps, (unsigned)(app->emulation.fps / 60.0 * 100.0));
+        if (igIsItemHovered(ImGuiHoveredFlags_None)) {
+            igSetTooltip(
+                "Frame pacing error: %uus (max: %uus)",
+                atomic_load_explicit(&app->emulation.gba->pacing_error.avg, memory_order_relaxed),
+                atomic_load_explicit(&app->emulation.gba->pacing_error.max, memory_order_relaxed)
+            );
+        }
         igGetItemRectSize(&out);
         app->ui.menubar_fps_width = out.x;
     }
@@ -7,6 +7,7 @@
 **
 \******************************************************************************/
 
+#define _GNU_SOURCE
 #define CIMGUI_DEFINE_ENUMS_AND_STRUCTS
 #include <GL/glew.h>
 
@@ -21,6 +22,7 @@
 #endif
 
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -217,6 +219,47 @@ args_parse(
     }
 }
 
+/*
+** Apply the scheduling options to the emulation thread: a real-time priority, to be
+** less likely to miss frame deadlines, and a CPU affinity.
+**
+** Both are best-effort: they usually require privileges or aren't supported by the OS.
+*/
+static
+void
+setup_emulation_thread(
+    struct app *app,
+    pthread_t thread
+) {
+#if !defined(_WIN32) || defined(__CYGWIN__)
+    if (app->emulation.realtime_priority) {
+        struct sched_param param;
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        if (pthread_setschedparam(thread, SCHED_FIFO, &param)) {
+            logln(HS_WARNING, "Failed to give the emulation thread a real-time priority.");
+        }
+    }
+#endif
+
+#ifdef __linux__
+    if (app->emulation.cpu_affinity >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(app->emulation.cpu_affinity, &set);
+        if (pthread_setaffinity_np(thread, sizeof(set), &set)) {
+            logln(HS_WARNING, "Failed to pin the emulation thread to CPU %i.", app->emulation.cpu_affinity);
+        }
+    }
+#else
+    if (app->emulation.cpu_affinity >= 0) {
+        logln(HS_WARNING, "Setting the emulation thread's CPU affinity isn't supported on this platform.");
+    }
+#endif
+}
+
 int
 main(
     int argc,
@@ -224,6 +267,8 @@ main(
 ) {
     struct app app;
     pthread_t gba_thread;
+    uint64_t render_period;
+    uint32_t timeout;
 #ifdef WITH_DEBUGGER
     pthread_t dbg_thread;
 #endif
@@ -244,12 +289,22 @@ main(
     app.emulation.backup_type = BACKUP_AUTO_DETECT;
     app.emulation.rtc_autodetect = true;
     app.emulation.rtc_force_enabled = true;
+    app.emulation.realtime_priority = false;
+    app.emulation.cpu_affinity = -1;
     app.video.color_correction = true;
+    app.video.threaded_rendering = false;
+    app.video.frame_skip = FRAME_SKIP_AUTO;
     app.video.vsync = false;
+    app.video.present_deadline = false;
     app.video.display_size = 3;
     app.video.aspect_ratio = ASPECT_RATIO_RESIZE;
     app.audio.mute = false;
     app.audio.level = 1.0f;
+    app.audio.buffer_size = 2048;
+    app.audio.audio_master = false;
+    app.audio.time_stretch = true;
+    app.audio.record_sources = false;
+    app.audio.record_format = APU_RECORD_WAV;
     app.video.texture_filter.kind = TEXTURE_FILTER_NEAREST;
     app.video.texture_filter.refresh = true;
     app.ui.win.resize = true;
@@ -286,6 +341,7 @@ main(
         (void *(*)(void *))gba_main_loop,
         app.emulation.gba
     );
+    setup_emulation_thread(&app, gba_thread);
 
 #ifdef WITH_DEBUGGER
     signal(SIGINT, &sighandler);
@@ -311,11 +367,26 @@ main(
     }
 #endif
 
+    timeout = 0;
+    render_period = 0;
     while (app.run) {
-        uint64_t sdl_counters[2];
-        float elapsed_ms;
-
-        sdl_counters[0] = SDL_GetPerformanceCounter();
+        /*
+        ** Sleep until there's something to do: an input, a new frame from the emulator or,
+        ** if nothing happens, the timeout (used for the periodic tasks below and ImGui's animations).
+        **
+        ** Then keep handling the events as they come until `render_period` has elapsed since the last
+        ** render, so that the ones coming in faster than that (mouse motions, frames of an emulator running
+        ** faster than the display...) are rendered together.
+        **
+        ** In the presentation-deadline mode, we instead handle the events as they come and render
+        ** right before the next vertical blank.
+        */
+        if (app.emulation.started && app.emulation.running && app.video.vsync && app.video.present_deadline) {
+            gui_sdl_video_wait_present_deadline(&app);
+        } else {
+            gui_sdl_wait_events(&app, timeout);
+            gui_sdl_handle_inputs_until(&app, app.ui.present.last_swap + render_period);
+        }
 
         gui_sdl_handle_inputs(&app);
         gui_sdl_video_render_frame(&app);
@@ -375,14 +446,12 @@ main(
             app.ui.win.resize_with_ratio = false;
         }
 
-        sdl_counters[1] = SDL_GetPerformanceCounter();
-        elapsed_ms = ((float)(sdl_counters[1] - sdl_counters[0]) / (float)SDL_GetPerformanceFrequency()) * 1000.f;
-
         if (app.emulation.started && app.emulation.running) {
+            // New frames wake us up, the timeout only matters if the emulator stalls.
+            timeout = 1000 / 15;
+
             // If the emulator is running without vsync, cap the gui's FPS to 4x the display's refresh rate
-            if (!app.video.vsync) {
-                SDL_Delay(max(0.f, floor((1000.f / (4.0 * app.ui.refresh_rate)) - elapsed_ms)));
-            }
+            render_period = app.video.vsync ? 0 : SDL_GetPerformanceFrequency() / (4 * max(1u, app.ui.refresh_rate));
 
             app.ui.power_save_fcounter = POWER_SAVE_FRAME_DELAY;
         } else {
@@ -397,11 +466,8 @@ main(
                 app.ui.power_save_fcounter = POWER_SAVE_FRAME_DELAY;
             }
 
-            if (use_power_save_mode) {
-                SDL_Delay(max(0.f, floor((1000.f / 15.0f) - elapsed_ms)));
-            } else {
-                SDL_Delay(max(0.f, floor((1000.f / 60.0f) - elapsed_ms)));
-            }
+            timeout = use_power_save_mode ? 1000 / 15 : 1000 / 60;
+            render_period = SDL_GetPerformanceFrequency() / (use_power_save_mode ? 15 : 60);
         }
     }
 
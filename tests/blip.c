@@ -0,0 +1,345 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2023 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Measure the quality of the band-limited synthesizer (see `gba/apu/blip.c`).
+**
+** Synthetic signals are fed through `apu_blip_add_step()` the same way the mixer does, and the
+** spectrum of the output is split between:
+**   - The signal, at the frequencies the input actually contains below the output's Nyquist frequency.
+**   - The aliases, at the frequencies the input's content above the Nyquist frequency folds back to.
+**   - The noise, which is everything else.
+**
+** The program fails if the SNR or the alias energy of any signal is worse than its expected bound.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hades.h"
+#include "gba/gba.h"
+#include "gba/apu.h"
+
+#define SAMPLE_RATE             48000
+#define FFT_SIZE                32768
+#define WARMUP                  (SAMPLE_RATE / 4)
+#define AMPLITUDE               8000
+
+// Half-width, in bins, of the main lobe of the Blackman-Harris window.
+#define LOBE_WIDTH              5
+
+#define SINE_FREQUENCY          1000
+#define SINE_SOURCE_PERIOD      512     // A 32768Hz source, like a FIFO fed by a timer
+#define SQUARE_FREQUENCY        1237
+
+enum bin_class {
+    BIN_NOISE,
+    BIN_ALIAS,
+    BIN_SIGNAL,
+};
+
+struct blip_signal {
+    char const *name;
+
+    // Return the amplitude of the `idx`-th step and the cycle it happens at.
+    int16_t (*step)(uint64_t idx, uint64_t *cycles);
+
+    // Mark the bins of the signal's content and of its aliases.
+    void (*classify)(enum bin_class *bins);
+
+    double min_snr;
+    double max_alias;
+};
+
+static struct gba gba;
+static int16_t samples[WARMUP + FFT_SIZE];
+static enum bin_class bins[FFT_SIZE / 2 + 1];
+static double re[FFT_SIZE];
+static double im[FFT_SIZE];
+
+/*
+** Mark the bins around the given frequency, folded back below the Nyquist frequency, as `class`.
+**
+** A signal bin is never downgraded to an alias one.
+*/
+static
+void
+classify_frequency(
+    enum bin_class *bins,
+    double frequency,
+    enum bin_class class
+) {
+    int64_t center;
+    int64_t i;
+
+    frequency = fmod(frequency, SAMPLE_RATE);
+    if (frequency > SAMPLE_RATE / 2) {
+        frequency = SAMPLE_RATE - frequency;
+    }
+
+    center = lround(frequency * FFT_SIZE / SAMPLE_RATE);
+    for (i = max(center - LOBE_WIDTH, 0); i <= min(center + LOBE_WIDTH, FFT_SIZE / 2); ++i) {
+        bins[i] = max(bins[i], class);
+    }
+}
+
+/*
+** A sine sampled at 32768Hz, the way a sound FIFO fed by a timer would play it.
+*/
+static
+int16_t
+sine_step(
+    uint64_t idx,
+    uint64_t *cycles
+) {
+    *cycles = idx * SINE_SOURCE_PERIOD;
+    return ((int16_t)lround(AMPLITUDE * sin(2.0 * M_PI * SINE_FREQUENCY * (double)*cycles / CYCLES_PER_SECOND)));
+}
+
+/*
+** The sample-and-hold of the source creates images of the sine around each multiple of the source's
+** frequency, which alias if they aren't filtered out.
+*/
+static
+void
+sine_classify(
+    enum bin_class *bins
+) {
+    double source;
+    uint32_t k;
+
+    source = (double)CYCLES_PER_SECOND / SINE_SOURCE_PERIOD;
+    for (k = 1; k < 16; ++k) {
+        classify_frequency(bins, k * source - SINE_FREQUENCY, BIN_ALIAS);
+        classify_frequency(bins, k * source + SINE_FREQUENCY, BIN_ALIAS);
+    }
+    classify_frequency(bins, SINE_FREQUENCY, BIN_SIGNAL);
+}
+
+/*
+** A square wave which edges happen at the exact cycle they should instead of on a grid, like the
+** PSG channels'.
+*/
+static
+int16_t
+square_step(
+    uint64_t idx,
+    uint64_t *cycles
+) {
+    *cycles = idx * CYCLES_PER_SECOND / (2 * SQUARE_FREQUENCY);
+    return ((idx % 2) ? -AMPLITUDE : AMPLITUDE);
+}
+
+/*
+** A square wave only contains odd harmonics, the ones above the Nyquist frequency alias if they
+** aren't filtered out.
+*/
+static
+void
+square_classify(
+    enum bin_class *bins
+) {
+    uint32_t k;
+
+    for (k = 1; k * SQUARE_FREQUENCY < 10 * SAMPLE_RATE; k += 2) {
+        if (k * SQUARE_FREQUENCY >= SAMPLE_RATE / 2) {
+            classify_frequency(bins, k * SQUARE_FREQUENCY, BIN_ALIAS);
+        }
+    }
+
+    for (k = 1; k * SQUARE_FREQUENCY < SAMPLE_RATE / 2; k += 2) {
+        classify_frequency(bins, k * SQUARE_FREQUENCY, BIN_SIGNAL);
+    }
+}
+
+/*
+** Feed the given signal to the synthesizer and store the left channel of its output in `samples`.
+*/
+static
+void
+blip_render(
+    struct blip_signal const *signal
+) {
+    uint32_t frames[APU_RBUFFER_CAPACITY];
+    uint64_t cycles;
+    uint64_t idx;
+    size_t len;
+    int16_t amplitude;
+
+    // Drop whatever is left from the previous signal
+    apu_rbuffer_pop(&gba.apu.frontend_channels, frames, apu_rbuffer_fill(&gba.apu.frontend_channels));
+
+    amplitude = signal->step(0, &cycles);
+    apu_blip_reset(&gba, cycles, ((uint32_t)(uint16_t)amplitude << 16) | (uint16_t)amplitude);
+
+    len = 0;
+    idx = 1;
+    while (len < array_length(samples)) {
+        size_t count;
+        size_t i;
+
+        amplitude = signal->step(idx++, &cycles);
+        apu_blip_add_step(&gba, cycles, ((uint32_t)(uint16_t)amplitude << 16) | (uint16_t)amplitude);
+
+        if (apu_rbuffer_fill(&gba.apu.frontend_channels) < APU_RBUFFER_CAPACITY / 2) {
+            continue;
+        }
+
+        count = apu_rbuffer_pop(&gba.apu.frontend_channels, frames, APU_RBUFFER_CAPACITY / 2);
+        for (i = 0; i < count && len < array_length(samples); ++i) {
+            samples[len++] = (int16_t)(frames[i] >> 16);
+        }
+    }
+}
+
+/*
+** In-place radix-2 FFT of `re` and `im`.
+*/
+static
+void
+fft(void)
+{
+    size_t len;
+    size_t i;
+    size_t j;
+
+    for (i = 1, j = 0; i < FFT_SIZE; ++i) {
+        size_t bit;
+
+        for (bit = FFT_SIZE >> 1; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j) {
+            double tmp;
+
+            tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+            tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+        }
+    }
+
+    for (len = 2; len <= FFT_SIZE; len <<= 1) {
+        double angle;
+
+        angle = -2.0 * M_PI / len;
+        for (i = 0; i < FFT_SIZE; i += len) {
+            for (j = 0; j < len / 2; ++j) {
+                double wr;
+                double wi;
+                double tr;
+                double ti;
+                size_t a;
+                size_t b;
+
+                wr = cos(angle * j);
+                wi = sin(angle * j);
+                a = i + j;
+                b = i + j + len / 2;
+                tr = re[b] * wr - im[b] * wi;
+                ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+/*
+** Measure the SNR and the alias energy, relative to the signal, of the content of `samples`.
+*/
+static
+void
+blip_analyze(
+    struct blip_signal const *signal,
+    double *snr,
+    double *alias
+) {
+    double energy[3];
+    size_t i;
+
+    for (i = 0; i < FFT_SIZE; ++i) {
+        double x;
+        double window;
+
+        // 4-term Blackman-Harris window, its sidelobes are well below what's being measured.
+        x = 2.0 * M_PI * i / (FFT_SIZE - 1);
+        window = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+        re[i] = samples[WARMUP + i] * window;
+        im[i] = 0.0;
+    }
+
+    fft();
+
+    memset(bins, 0, sizeof(bins));
+    signal->classify(bins);
+
+    memset(energy, 0, sizeof(energy));
+    for (i = LOBE_WIDTH + 1; i <= FFT_SIZE / 2; ++i) {
+        energy[bins[i]] += re[i] * re[i] + im[i] * im[i];
+    }
+
+    *snr = 10.0 * log10(energy[BIN_SIGNAL] / (energy[BIN_ALIAS] + energy[BIN_NOISE]));
+    *alias = 10.0 * log10(energy[BIN_ALIAS] / energy[BIN_SIGNAL]);
+}
+
+int
+main(void)
+{
+    static struct blip_signal const signals[] = {
+        {
+            .name = "sine 1kHz, 32768Hz source",
+            .step = sine_step,
+            .classify = sine_classify,
+            .min_snr = 50.0,
+            .max_alias = -70.0,
+        },
+        {
+            .name = "square 1237Hz",
+            .step = square_step,
+            .classify = square_classify,
+            .min_snr = 40.0,
+            .max_alias = -40.0,
+        },
+    };
+    bool success;
+    size_t i;
+
+    apu_blip_build_kernels();
+    apu_rbuffer_init(&gba.apu.frontend_channels);
+    gba.apu.resample_period = ((uint64_t)CYCLES_PER_SECOND << APU_RESAMPLE_SHIFT) / SAMPLE_RATE;
+    gba.apu.resample_step = gba.apu.resample_period;
+
+    success = true;
+    for (i = 0; i < array_length(signals); ++i) {
+        double alias;
+        double snr;
+        bool ok;
+
+        blip_render(&signals[i]);
+        blip_analyze(&signals[i], &snr, &alias);
+
+        ok = snr >= signals[i].min_snr && alias <= signals[i].max_alias;
+        printf(
+            "%-28s SNR %6.1f dB (min %.0f), alias energy %6.1f dB (max %.0f) %s\n",
+            signals[i].name,
+            snr,
+            signals[i].min_snr,
+            alias,
+            signals[i].max_alias,
+            ok ? "OK" : "FAIL"
+        );
+        success &= ok;
+    }
+
+    return (success ? EXIT_SUCCESS : EXIT_FAILURE);
+}